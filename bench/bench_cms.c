@@ -0,0 +1,293 @@
+/*
+ * bench_cms — end-to-end latency benchmark for the CMS (POSIX only).
+ *
+ *   bench_cms <cms-binary> <TeamName> [label]
+ *
+ * Runs the CMS as a child process on pipes, in the current directory, which
+ * must contain <TeamName>-CMS.txt (see gen_roster). Each command is timed
+ * from the moment it is written until the next "You: " prompt arrives, so
+ * the numbers include formatting and piping the whole result.
+ *
+ * Workload: OPEN, QUERY storm, SHOW ALL SORT BY each key, FIND NAME /
+ * FIND PROGRAMME, SHOW SUMMARY, SHOW PROGRAMME SUMMARY, INSERT storm,
+ * EXPORT CSV and SAVE. Repetition counts can be scaled with BENCH_SCALE
+ * (default 1.0).
+ *
+ * Output is one JSON object per line on stdout:
+ *   {"label":..,"rows":..,"op":"QUERY","n":2000,"p50_us":..,"p90_us":..,
+ *    "p99_us":..,"max_us":..,"mean_us":..,"ops_per_s":..}
+ * and a final {"label":..,"rows":..,"op":"TOTAL",...,"peak_rss_kb":..}.
+ *
+ * Build: gcc -std=c99 -O2 bench/bench_cms.c -o bench_cms
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#define ID_BASE  1000000
+#define ID_SPACE 9000000
+
+static int to_child = -1, from_child = -1;
+static pid_t child = -1;
+static char rbuf[1 << 20];
+static long long out_bytes = 0;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void start_cms(const char* bin) {
+    int in[2], out[2];
+    if (pipe(in) != 0 || pipe(out) != 0) { perror("pipe"); exit(1); }
+    child = fork();
+    if (child < 0) { perror("fork"); exit(1); }
+    if (child == 0) {
+        dup2(in[0], 0); dup2(out[1], 1); dup2(out[1], 2);
+        close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+        execl(bin, bin, (char*)NULL);
+        perror(bin);
+        _exit(127);
+    }
+    close(in[0]); close(out[1]);
+    to_child = in[1]; from_child = out[0];
+}
+
+/* read until the output ends with the "You: " prompt (or the child exits) */
+static int wait_prompt(void) {
+    char tail[5] = {0};
+    int have = 0;
+    for (;;) {
+        ssize_t n = read(from_child, rbuf, sizeof(rbuf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        out_bytes += n;
+        /* keep the last five bytes seen across reads */
+        for (ssize_t i = n > 5 ? n - 5 : 0; i < n; ++i) {
+            if (have == 5) { memmove(tail, tail + 1, 4); have = 4; }
+            tail[have++] = rbuf[i];
+        }
+        if (have == 5 && memcmp(tail, "You: ", 5) == 0) return 1;
+    }
+}
+
+static void send_line(const char* line) {
+    size_t len = strlen(line), done = 0;
+    while (done < len) {
+        ssize_t n = write(to_child, line + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { perror("write"); exit(1); }
+        done += (size_t)n;
+    }
+}
+
+/* ---- per-operation latency samples ---- */
+typedef struct {
+    char op[32];
+    double* us;
+    int n, cap;
+} Series;
+
+static Series series[32];
+static int n_series = 0;
+
+static Series* series_get(const char* op) {
+    for (int i = 0; i < n_series; ++i) if (strcmp(series[i].op, op) == 0) return &series[i];
+    if (n_series == (int)(sizeof(series)/sizeof(series[0]))) { fprintf(stderr, "bench_cms: too many ops\n"); exit(1); }
+    Series* s = &series[n_series++];
+    snprintf(s->op, sizeof(s->op), "%s", op);
+    s->us = NULL; s->n = s->cap = 0;
+    return s;
+}
+
+static void record(const char* op, double us) {
+    Series* s = series_get(op);
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 64;
+        s->us = (double*)realloc(s->us, sizeof(double) * (size_t)s->cap);
+        if (!s->us) { perror("realloc"); exit(1); }
+    }
+    s->us[s->n++] = us;
+}
+
+/* send one command and time it until the next prompt */
+static void timed(const char* op, const char* cmd) {
+    double t0 = now_us();
+    send_line(cmd);
+    if (!wait_prompt()) { fprintf(stderr, "bench_cms: CMS exited during \"%s\"\n", op); exit(1); }
+    record(op, now_us() - t0);
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double pct(const double* v, int n, int p) {
+    return v[(int)((long long)(n - 1) * p / 100)];
+}
+
+static void emit(const char* label, long rows, const Series* s) {
+    double* v = s->us;
+    qsort(v, (size_t)s->n, sizeof(double), cmp_double);
+    double sum = 0;
+    for (int i = 0; i < s->n; ++i) sum += v[i];
+    printf("{\"label\":\"%s\",\"rows\":%ld,\"op\":\"%s\",\"n\":%d,"
+           "\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f,"
+           "\"mean_us\":%.1f,\"ops_per_s\":%.1f}\n",
+           label, rows, s->op, s->n, pct(v, s->n, 50), pct(v, s->n, 90), pct(v, s->n, 99),
+           v[s->n - 1], sum / s->n, sum > 0 ? s->n * 1e6 / sum : 0.0);
+}
+
+/* ---- workload input taken from the roster file ---- */
+static int* ids = NULL;
+static long n_ids = 0;
+static unsigned char* used = NULL;   /* bitmap over the 7-digit ID space */
+static char (*name_sample)[128] = NULL;
+static int n_names = 0;
+#define NAME_SAMPLE 1024
+
+static uint64_t rng = 88172645463325252ull;
+static uint64_t rnd(void) { rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17; return rng; }
+
+static void scan_roster(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) { perror(path); exit(1); }
+    used = (unsigned char*)calloc(ID_SPACE / 8 + 1, 1);
+    name_sample = calloc(NAME_SAMPLE, sizeof(*name_sample));
+    if (!used || !name_sample) { perror("calloc"); exit(1); }
+    long cap = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        char* bar = strchr(line, '|');
+        if (!bar) continue;
+        int id = atoi(line);
+        if (n_ids == cap) {
+            cap = cap ? cap * 2 : 4096;
+            ids = (int*)realloc(ids, sizeof(int) * (size_t)cap);
+            if (!ids) { perror("realloc"); exit(1); }
+        }
+        ids[n_ids++] = id;
+        if (id >= ID_BASE && id < ID_BASE + ID_SPACE) used[(id - ID_BASE) >> 3] |= (unsigned char)(1u << ((id - ID_BASE) & 7));
+        /* reservoir sample of names for FIND */
+        char* end = strchr(bar + 1, '|');
+        if (!end) continue;
+        *end = 0;
+        long slot = n_names < NAME_SAMPLE ? n_names++ : (long)(rnd() % (uint64_t)n_ids);
+        if (slot < NAME_SAMPLE) { strncpy(name_sample[slot], bar + 1, 127); name_sample[slot][127] = 0; }
+    }
+    fclose(f);
+}
+
+static int next_free_id(void) {
+    for (int tries = 0; tries < ID_SPACE; ++tries) {
+        int k = (int)(rnd() % ID_SPACE);
+        if (!(used[k >> 3] & (1u << (k & 7)))) { used[k >> 3] |= (unsigned char)(1u << (k & 7)); return ID_BASE + k; }
+    }
+    return ID_BASE;   /* roster is full: INSERT will be rejected, still timed */
+}
+
+static int scaled(double scale, int n) { int v = (int)(n * scale); return v < 1 ? 1 : v; }
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <cms-binary> <TeamName> [label]\n", argv[0]);
+        return 2;
+    }
+    const char* bin = argv[1];
+    const char* team = argv[2];
+    const char* label = argc > 3 ? argv[3] : "cms";
+    double scale = getenv("BENCH_SCALE") ? atof(getenv("BENCH_SCALE")) : 1.0;
+    if (scale <= 0) scale = 1.0;
+    signal(SIGPIPE, SIG_IGN);
+
+    char path[512], cmd[1024];
+    snprintf(path, sizeof(path), "%s-CMS.txt", team);
+    scan_roster(path);
+
+    double t_start = now_us();
+    start_cms(bin);
+    if (!wait_prompt()) { fprintf(stderr, "bench_cms: no prompt from %s\n", bin); return 1; }
+
+    snprintf(cmd, sizeof(cmd), "OPEN %s\n", team);
+    timed("OPEN", cmd);
+
+    for (int i = 0, n = scaled(scale, 2000); i < n && n_ids > 0; ++i) {
+        snprintf(cmd, sizeof(cmd), "QUERY ID=%d\n", ids[rnd() % (uint64_t)n_ids]);
+        timed("QUERY", cmd);
+    }
+
+    static const char* keys[] = { "ID", "MARK", "PROGRAMME", "NAME" };
+    for (int k = 0; k < 4; ++k) {
+        char op[32];
+        snprintf(op, sizeof(op), "SHOW_ALL_%s", keys[k]);
+        for (int i = 0, n = scaled(scale, 3); i < n; ++i) {
+            snprintf(cmd, sizeof(cmd), "SHOW ALL SORT BY %s %s\n", keys[k], i & 1 ? "DESC" : "ASC");
+            timed(op, cmd);
+        }
+        snprintf(op, sizeof(op), "SHOW_TOP_%s", keys[k]);
+        for (int i = 0, n = scaled(scale, 200); i < n; ++i) {
+            snprintf(cmd, sizeof(cmd), "SHOW ALL SORT BY %s DESC TOP 10\n", keys[k]);
+            timed(op, cmd);
+        }
+    }
+
+    for (int i = 0, n = scaled(scale, 200); i < n && n_names > 0; ++i) {
+        /* a 4-character slice of a real name: selective but not unique */
+        const char* nm = name_sample[rnd() % (uint64_t)n_names];
+        size_t len = strlen(nm), at = len > 4 ? (size_t)(rnd() % (len - 3)) : 0;
+        snprintf(cmd, sizeof(cmd), "FIND NAME=\"%.4s\"\n", nm + at);
+        timed("FIND_NAME", cmd);
+    }
+    static const char* prog_keys[] = { "Therapy", "Engineering", "Nursing", "Design", "Xyz" };
+    for (int i = 0, n = scaled(scale, 20); i < n; ++i) {
+        snprintf(cmd, sizeof(cmd), "FIND PROGRAMME=\"%s\"\n", prog_keys[i % 5]);
+        timed("FIND_PROGRAMME", cmd);
+    }
+
+    for (int i = 0, n = scaled(scale, 50); i < n; ++i) timed("SHOW_SUMMARY", "SHOW SUMMARY\n");
+    for (int i = 0, n = scaled(scale, 20); i < n; ++i) timed("SHOW_PROGRAMME_SUMMARY", "SHOW PROGRAMME SUMMARY\n");
+
+    for (int i = 0, n = scaled(scale, 5000); i < n; ++i) {
+        snprintf(cmd, sizeof(cmd), "INSERT ID=%d Name=\"Bench Student %d\" Programme=\"Software Engineering\" Mark=%d.%02d\n",
+                 next_free_id(), i, (int)(rnd() % 100), (int)(rnd() % 100));
+        timed("INSERT", cmd);
+    }
+
+    timed("EXPORT", "EXPORT CSV=\"bench_export.csv\"\n");
+    timed("SAVE", "SAVE\n");
+
+    send_line("EXIT\n");
+    close(to_child);
+    while (read(from_child, rbuf, sizeof(rbuf)) > 0) {}
+    int status = 0;
+    waitpid(child, &status, 0);
+    double total_us = now_us() - t_start;
+
+    struct rusage ru;
+    getrusage(RUSAGE_CHILDREN, &ru);
+#ifdef __APPLE__
+    long peak_kb = ru.ru_maxrss / 1024;   /* bytes on macOS */
+#else
+    long peak_kb = ru.ru_maxrss;          /* kilobytes on Linux/BSD */
+#endif
+
+    for (int i = 0; i < n_series; ++i) emit(label, n_ids, &series[i]);
+    printf("{\"label\":\"%s\",\"rows\":%ld,\"op\":\"TOTAL\",\"wall_s\":%.3f,\"user_s\":%.3f,"
+           "\"sys_s\":%.3f,\"output_bytes\":%lld,\"peak_rss_kb\":%ld}\n",
+           label, n_ids, total_us / 1e6,
+           ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6,
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6,
+           out_bytes, peak_kb);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+/*
+ * bench_serve — multi-client throughput benchmark for `cms --serve` (POSIX only).
+ *
+ *   bench_serve <cms-binary> <TeamName> [label]
+ *
+ * Starts `cms --serve bench.sock <TeamName>` in the current directory, which
+ * must contain <TeamName>-CMS.txt (see gen_roster), then drives it with 1, 2,
+ * 4, ... clients up to twice the CPU count. Each client is a thread with its
+ * own connection that sends a command, waits for the "You: " prompt, and
+ * repeats for BENCH_SECONDS (default 2) per client count.
+ *
+ * Workloads:
+ *   SERVE_READ   80% QUERY, 10% SHOW ALL SORT BY MARK DESC TOP 10,
+ *                10% FIND PROGRAMME — all run under the shared lock
+ *   SERVE_MIXED  the same with every tenth command an INSERT
+ *
+ * Output is one JSON object per line on stdout:
+ *   {"label":..,"rows":..,"op":"SERVE_READ","clients":4,"n":..,
+ *    "p50_us":..,"p99_us":..,"ops_per_s":..}
+ *
+ * Build: gcc -std=c99 -O2 -pthread bench/bench_serve.c -o bench_serve
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define SOCK_PATH "bench.sock"
+#define MAX_CLIENTS 256
+
+static int* ids = NULL;
+static long n_ids = 0;
+static double seconds = 2.0;
+static int mixed = 0;
+static int next_insert = 0;
+static pthread_mutex_t insert_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void load_ids(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) { perror(path); exit(1); }
+    long cap = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        if (!strchr(line, '|')) continue;
+        if (n_ids == cap) {
+            cap = cap ? cap * 2 : 4096;
+            ids = (int*)realloc(ids, sizeof(int) * (size_t)cap);
+            if (!ids) { perror("realloc"); exit(1); }
+        }
+        ids[n_ids++] = atoi(line);
+    }
+    fclose(f);
+}
+
+static int connect_server(void) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, SOCK_PATH);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) { close(fd); return -1; }
+    return fd;
+}
+
+/* read until the output ends with the "You: " prompt */
+static int wait_prompt(int fd, char* buf, size_t cap) {
+    char tail[5] = {0};
+    int have = 0;
+    for (;;) {
+        ssize_t n = read(fd, buf, cap);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        for (ssize_t i = n > 5 ? n - 5 : 0; i < n; ++i) {
+            if (have == 5) { memmove(tail, tail + 1, 4); have = 4; }
+            tail[have++] = buf[i];
+        }
+        if (have == 5 && memcmp(tail, "You: ", 5) == 0) return 1;
+    }
+}
+
+static int send_all(int fd, const char* s) {
+    size_t len = strlen(s), done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, s + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        done += (size_t)n;
+    }
+    return 1;
+}
+
+typedef struct {
+    int seed;
+    double* us;
+    int n, cap;
+} Client;
+
+static void* client_run(void* arg) {
+    Client* c = (Client*)arg;
+    static const char* progs[] = { "Therapy", "Engineering", "Nursing", "Design" };
+    uint64_t rng = 0x9E3779B97F4A7C15ull * (uint64_t)(c->seed + 1);
+    char cmd[256];
+    char* buf = (char*)malloc(1 << 16);
+    int fd = connect_server();
+    if (fd < 0 || !buf || !wait_prompt(fd, buf, 1 << 16)) { fprintf(stderr, "bench_serve: cannot connect\n"); exit(1); }
+    double end = now_us() + seconds * 1e6;
+    for (int i = 0; now_us() < end; ++i) {
+        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+        int r = (int)(rng % 10);
+        if (mixed && i % 10 == 9) {
+            pthread_mutex_lock(&insert_lock);
+            int id = 9999999 - next_insert++;   /* counts down from the top of the ID space */
+            pthread_mutex_unlock(&insert_lock);
+            snprintf(cmd, sizeof(cmd), "INSERT ID=%d Name=\"Serve Bench\" Programme=\"Nursing\" Mark=50\n", id);
+        } else if (r == 0) {
+            snprintf(cmd, sizeof(cmd), "SHOW ALL SORT BY MARK DESC TOP 10\n");
+        } else if (r == 1) {
+            snprintf(cmd, sizeof(cmd), "FIND PROGRAMME=\"%s\"\n", progs[(rng >> 8) % 4]);
+        } else {
+            snprintf(cmd, sizeof(cmd), "QUERY ID=%d\n", n_ids ? ids[(rng >> 8) % (uint64_t)n_ids] : 1000000);
+        }
+        double t0 = now_us();
+        if (!send_all(fd, cmd) || !wait_prompt(fd, buf, 1 << 16)) { fprintf(stderr, "bench_serve: server hung up\n"); exit(1); }
+        if (c->n == c->cap) {
+            c->cap = c->cap ? c->cap * 2 : 1024;
+            c->us = (double*)realloc(c->us, sizeof(double) * (size_t)c->cap);
+            if (!c->us) { perror("realloc"); exit(1); }
+        }
+        c->us[c->n++] = now_us() - t0;
+    }
+    send_all(fd, "EXIT\n");
+    close(fd);
+    free(buf);
+    return NULL;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void run(const char* label, const char* op, int clients) {
+    static Client cl[MAX_CLIENTS];
+    pthread_t th[MAX_CLIENTS];
+    for (int i = 0; i < clients; ++i) { cl[i].seed = i; cl[i].n = 0; }
+    double t0 = now_us();
+    for (int i = 0; i < clients; ++i) pthread_create(&th[i], NULL, client_run, &cl[i]);
+    for (int i = 0; i < clients; ++i) pthread_join(th[i], NULL);
+    double wall = now_us() - t0;
+
+    int total = 0;
+    for (int i = 0; i < clients; ++i) total += cl[i].n;
+    double* v = (double*)malloc(sizeof(double) * (size_t)(total ? total : 1));
+    if (!v) { perror("malloc"); exit(1); }
+    for (int i = 0, k = 0; i < clients; ++i) { memcpy(v + k, cl[i].us, sizeof(double) * (size_t)cl[i].n); k += cl[i].n; }
+    qsort(v, (size_t)total, sizeof(double), cmp_double);
+    printf("{\"label\":\"%s\",\"rows\":%ld,\"op\":\"%s\",\"clients\":%d,\"n\":%d,"
+           "\"p50_us\":%.1f,\"p99_us\":%.1f,\"ops_per_s\":%.1f}\n",
+           label, n_ids, op, clients, total,
+           total ? v[(total - 1) / 2] : 0.0, total ? v[(int)((long long)(total - 1) * 99 / 100)] : 0.0,
+           total * 1e6 / wall);
+    fflush(stdout);
+    free(v);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <cms-binary> <TeamName> [label]\n", argv[0]);
+        return 2;
+    }
+    const char* bin = argv[1];
+    const char* team = argv[2];
+    const char* label = argc > 3 ? argv[3] : "cms";
+    if (getenv("BENCH_SECONDS")) seconds = atof(getenv("BENCH_SECONDS"));
+    if (seconds <= 0) seconds = 2.0;
+    signal(SIGPIPE, SIG_IGN);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s-CMS.txt", team);
+    load_ids(path);
+
+    unlink(SOCK_PATH);
+    pid_t server = fork();
+    if (server < 0) { perror("fork"); return 1; }
+    if (server == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) { dup2(devnull, 1); dup2(devnull, 2); }
+        execl(bin, bin, "--serve", SOCK_PATH, team, (char*)NULL);
+        _exit(127);
+    }
+    /* the server opens the roster before it listens; give large files time */
+    int fd = -1;
+    struct timespec pause = { 0, 50 * 1000 * 1000 };
+    for (int tries = 0; tries < 1200 && (fd = connect_server()) < 0; ++tries) nanosleep(&pause, NULL);
+    if (fd < 0) { fprintf(stderr, "bench_serve: server did not start\n"); kill(server, SIGTERM); return 1; }
+    close(fd);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_clients = (int)(cpus > 0 ? cpus * 2 : 2);
+    if (max_clients > MAX_CLIENTS) max_clients = MAX_CLIENTS;
+    for (int m = 0; m < 2; ++m) {
+        mixed = m;
+        for (int c = 1; c <= max_clients; c *= 2) run(label, m ? "SERVE_MIXED" : "SERVE_READ", c);
+    }
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(SOCK_PATH);
+    return 0;
+}
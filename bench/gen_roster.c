@@ -0,0 +1,117 @@
+/*
+ * gen_roster — synthetic <Team>-CMS.txt generator for the CMS benchmarks.
+ *
+ *   gen_roster <rows> <out-file> [seed]
+ *
+ * Writes <rows> records in the text database format (ID|Name|Programme|Mark).
+ *  - IDs are unique 7-digit numbers in shuffled order (an affine permutation
+ *    of 1000000..9999999), so at most 9,000,000 rows can be generated.
+ *  - Programmes follow a Zipf-like distribution: a few large programmes and
+ *    a long tail of small ones.
+ *  - Names have 2-5 words, so lengths vary from ~6 to ~50 characters.
+ *  - Marks are roughly normal around 65 (sd ~15), clipped to 0..100.
+ *
+ * Build: gcc -std=c99 -O2 bench/gen_roster.c -o gen_roster -lm
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define ID_BASE  1000000
+#define ID_SPACE 9000000u        /* 7-digit IDs */
+#define ID_STEP  5000011u        /* coprime with ID_SPACE (not divisible by 2, 3 or 5) */
+
+static const char* programmes[] = {
+    "Software Engineering", "Computer Science", "Information Security", "Applied Ai",
+    "Data Science", "Digital Supply Chain", "Interactive Media", "Computer Engineering",
+    "Electrical Engineering", "Mechanical Design", "Civil Engineering", "Chemical Engineering",
+    "Accountancy", "Business Analytics", "Hospitality Business", "Air Transport Management",
+    "Aircraft Systems Engineering", "Marine Engineering", "Naval Architecture", "Nursing",
+    "Physiotherapy", "Occupational Therapy", "Diagnostic Radiography", "Radiation Therapy",
+    "Food Technology", "Pharmaceutical Engineering", "Sustainable Infrastructure",
+    "Telematics And Wireless Systems", "Game Design", "Digital Art And Animation",
+    "Communication Design", "Robotics Systems", "Financial Technology", "Social Work",
+    "Dietetics And Nutrition", "Speech And Language Therapy",
+};
+#define N_PROGS ((int)(sizeof(programmes)/sizeof(programmes[0])))
+
+static const char* first_names[] = {
+    "Alice", "Bob", "Joshua", "Isaac", "John", "Mei", "Wei", "Siti", "Raj", "Kumar",
+    "Jo", "Ann", "Nur", "Aisyah", "Muhammad", "Hui", "Xin", "Priya", "Arjun", "Daniel",
+    "Chloe", "Ethan", "Sarah", "Marcus", "Li", "Jia", "Farah", "Hafiz", "Ming", "Rachel",
+    "Zhi", "Amal", "Kai", "Jun", "David", "Nadiy", "Bryan", "Clara", "Devi", "Ravi",
+};
+static const char* last_names[] = {
+    "Tan", "Lim", "Chen", "Teo", "Levoy", "Ng", "Lee", "Wong", "Goh", "Ong",
+    "Koh", "Chua", "Yeo", "Ho", "Low", "Sim", "Pillai", "Rahman", "Abdullah", "Krishnan",
+    "Fernandez", "Nair", "Subramaniam", "Yong", "Liaw", "Hin", "Tay", "Seah", "Quek", "Balakrishnan",
+};
+#define N_FIRST ((int)(sizeof(first_names)/sizeof(first_names[0])))
+#define N_LAST  ((int)(sizeof(last_names)/sizeof(last_names[0])))
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {   /* xorshift64* */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+static double rng_unit(void) { return (double)(rng_next() >> 11) / 9007199254740992.0; }
+
+static int rng_below(int n) { return (int)(rng_unit() * n); }
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <rows> <out-file> [seed]\n", argv[0]);
+        return 2;
+    }
+    long rows = atol(argv[1]);
+    if (rows < 0 || rows > (long)ID_SPACE) {
+        fprintf(stderr, "gen_roster: rows must be 0..%u (7-digit IDs)\n", ID_SPACE);
+        return 2;
+    }
+    uint64_t seed = argc > 3 ? strtoull(argv[3], NULL, 10) : 1;
+    rng_state = seed * 0x9E3779B97F4A7C15ull + 1;
+
+    /* Zipf weights 1/k^1.1 as a cumulative table */
+    double cum[N_PROGS], total = 0;
+    for (int k = 0; k < N_PROGS; ++k) {
+        total += 1.0 / pow(k + 1.0, 1.1);
+        cum[k] = total;
+    }
+
+    FILE* f = fopen(argv[2], "w");
+    if (!f) { perror(argv[2]); return 1; }
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+    uint32_t offset = (uint32_t)(rng_next() % ID_SPACE);
+    for (long i = 0; i < rows; ++i) {
+        int id = ID_BASE + (int)(((uint64_t)i * ID_STEP + offset) % ID_SPACE);
+
+        char name[128];
+        int words = 2 + (rng_below(10) < 3) + (rng_below(20) == 0) + (rng_below(50) == 0);
+        size_t len = 0;
+        for (int w = 0; w < words; ++w) {
+            const char* part = (w == words - 1) ? last_names[rng_below(N_LAST)] : first_names[rng_below(N_FIRST)];
+            len += (size_t)snprintf(name + len, sizeof(name) - len, "%s%s", w ? " " : "", part);
+        }
+
+        double u = rng_unit() * total;
+        int p = 0;
+        while (p < N_PROGS - 1 && cum[p] < u) p++;
+
+        /* sum of four uniforms ~ normal; mean 65, sd ~15 */
+        double g = (rng_unit() + rng_unit() + rng_unit() + rng_unit() - 2.0) * 26.0 + 65.0;
+        int hundredths = (int)(g * 100.0 + 0.5);
+        if (hundredths < 0) hundredths = 0;
+        if (hundredths > 10000) hundredths = 10000;
+
+        fprintf(f, "%d|%s|%s|%d.%02d\n", id, name, programmes[p], hundredths / 100, hundredths % 100);
+    }
+    if (fclose(f) != 0) { perror(argv[2]); return 1; }
+    return 0;
+}
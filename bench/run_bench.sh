@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+# Build the CMS and the benchmark tools, then benchmark generated rosters.
+#   bench/run_bench.sh [rows ...]        (default: 1000 100000 1000000)
+# Results (JSON lines) are appended to bench_output.txt in the repo root.
+# BENCH_LABEL names the run (default: short git hash); BENCH_SCALE scales
+# the repetition counts; BENCH_SECONDS sets each server throughput run.
+set -e
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+echo "Compiling cms.c and bench tools ..."
+gcc -std=c99 -O2 -pthread "$root/cms.c" -o "$work/cms"
+gcc -std=c99 -O2 "$root/bench/gen_roster.c" -o "$work/gen_roster" -lm
+gcc -std=c99 -O2 "$root/bench/bench_cms.c" -o "$work/bench_cms"
+gcc -std=c99 -O2 -pthread "$root/bench/bench_serve.c" -o "$work/bench_serve"
+
+label=${BENCH_LABEL:-$(git -C "$root" rev-parse --short HEAD 2>/dev/null || echo local)}
+out="$root/bench_output.txt"
+sizes=${*:-1000 100000 1000000}
+
+for rows in $sizes; do
+  echo "=== $rows rows ==="
+  (cd "$work" && ./gen_roster "$rows" BENCH-CMS.txt 1 && ./bench_cms ./cms BENCH "$label") | tee -a "$out"
+  rm -f "$work"/BENCH-CMS.* "$work"/bench_export.csv
+  (cd "$work" && ./gen_roster "$rows" BENCH-CMS.txt 1 && ./bench_serve ./cms BENCH "$label") | tee -a "$out"
+  rm -f "$work"/BENCH-CMS.*
+done
+echo "Results appended to $out"
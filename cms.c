@@ -14,17 +14,58 @@
  *  - OPEN, SHOW ALL, INSERT, QUERY, UPDATE, DELETE, SAVE
  *  - Sorting: SHOW ALL SORT BY ID|MARK ASC|DESC
  *  - Summary: SHOW SUMMARY (count, avg, hi/lo with names, grade bands)
- *  - Unique: UNDO (revert last INSERT/UPDATE/DELETE)
+ *  - Unique: UNDO/REDO (revert or reapply INSERT/UPDATE/DELETE)
  *  - HELP, EXIT
+ *  - Server mode: cms --serve <socket> [TeamName] (macOS/Linux)
  *
  * Build:
- *   gcc -std=c99 -O2 cms.c -o cms
+ *   gcc -std=c99 -O2 -pthread cms.c -o cms      (macOS/Linux)
+ *   gcc -std=c99 -O2 cms.c -o cms.exe           (Windows)
  */
 
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <float.h>
+#include <stddef.h>
+#include <time.h>
+#include <stdarg.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#define fsync_file(fp) _commit(_fileno(fp))
+#else
+#include <pthread.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <errno.h>
+#define fsync_file(fp) fsync(fileno(fp))
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CMS_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define CMS_AVX2 1
+#include <immintrin.h>
+#endif
 
 #ifdef _MSC_VER
 #define strdup _strdup
@@ -32,11 +73,129 @@
 #define strcasecmp _stricmp
 #endif
 
-#define MAX_RECORDS 10000
 #define MAX_NAME 128
 #define MAX_PROG 128
 #define MAX_LINE 1024
 
+/* ---- Portable threads: pthreads, or Win32 threads on Windows ---- */
+typedef void* (*cms_thread_fn)(void*);
+
+#ifdef _WIN32
+typedef struct { HANDLE h; } cms_thread;
+typedef struct { cms_thread_fn fn; void* arg; } cms_thread_boot;
+
+static DWORD WINAPI cms_thread_trampoline(LPVOID p) {
+    cms_thread_boot b = *(cms_thread_boot*)p;
+    free(p);
+    b.fn(b.arg);
+    return 0;
+}
+
+static int cms_thread_start(cms_thread* t, cms_thread_fn fn, void* arg) {
+    cms_thread_boot* b = (cms_thread_boot*)malloc(sizeof(*b));
+    if (!b) return 0;
+    b->fn = fn; b->arg = arg;
+    t->h = CreateThread(NULL, 0, cms_thread_trampoline, b, 0, NULL);
+    if (!t->h) { free(b); return 0; }
+    return 1;
+}
+
+static void cms_thread_join(cms_thread* t) {
+    WaitForSingleObject(t->h, INFINITE);
+    CloseHandle(t->h);
+}
+
+static int cms_cpu_count(void) {
+    SYSTEM_INFO si; GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+}
+
+typedef SRWLOCK cms_rwlock;
+typedef SRWLOCK cms_mutex;
+#define CMS_RWLOCK_INIT SRWLOCK_INIT
+#define CMS_MUTEX_INIT  SRWLOCK_INIT
+static void cms_read_lock(cms_rwlock* l)    { AcquireSRWLockShared(l); }
+static void cms_read_unlock(cms_rwlock* l)  { ReleaseSRWLockShared(l); }
+static void cms_write_lock(cms_rwlock* l)   { AcquireSRWLockExclusive(l); }
+static void cms_write_unlock(cms_rwlock* l) { ReleaseSRWLockExclusive(l); }
+static void cms_mutex_lock(cms_mutex* m)    { AcquireSRWLockExclusive(m); }
+static void cms_mutex_unlock(cms_mutex* m)  { ReleaseSRWLockExclusive(m); }
+typedef CONDITION_VARIABLE cms_cond;
+#define CMS_COND_INIT CONDITION_VARIABLE_INIT
+static void cms_cond_wait(cms_cond* c, cms_mutex* m) { SleepConditionVariableSRW(c, m, INFINITE, 0); }
+static void cms_cond_broadcast(cms_cond* c)        { WakeAllConditionVariable(c); }
+#else
+typedef struct { pthread_t h; } cms_thread;
+
+static int cms_thread_start(cms_thread* t, cms_thread_fn fn, void* arg) {
+    return pthread_create(&t->h, NULL, fn, arg) == 0;
+}
+
+static void cms_thread_join(cms_thread* t) {
+    pthread_join(t->h, NULL);
+}
+
+static int cms_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+typedef pthread_rwlock_t cms_rwlock;
+typedef pthread_mutex_t cms_mutex;
+#define CMS_RWLOCK_INIT PTHREAD_RWLOCK_INITIALIZER
+#define CMS_MUTEX_INIT  PTHREAD_MUTEX_INITIALIZER
+static void cms_read_lock(cms_rwlock* l)    { pthread_rwlock_rdlock(l); }
+static void cms_read_unlock(cms_rwlock* l)  { pthread_rwlock_unlock(l); }
+static void cms_write_lock(cms_rwlock* l)   { pthread_rwlock_wrlock(l); }
+static void cms_write_unlock(cms_rwlock* l) { pthread_rwlock_unlock(l); }
+static void cms_mutex_lock(cms_mutex* m)    { pthread_mutex_lock(m); }
+static void cms_mutex_unlock(cms_mutex* m)  { pthread_mutex_unlock(m); }
+typedef pthread_cond_t cms_cond;
+#define CMS_COND_INIT PTHREAD_COND_INITIALIZER
+static void cms_cond_wait(cms_cond* c, cms_mutex* m) { pthread_cond_wait(c, m); }
+static void cms_cond_broadcast(cms_cond* c)        { pthread_cond_broadcast(c); }
+#endif
+
+#if defined(_MSC_VER)
+#define CMS_TLS __declspec(thread)
+#else
+#define CMS_TLS __thread
+#endif
+
+/* ---- Sessions ----
+ * Command output goes through out_printf to the current thread's session:
+ * the console (stdin/stdout) or one --serve client connection. */
+typedef struct OutBuf OutBuf;
+
+typedef struct {
+    FILE* in;        /* DELETE's Y/N prompt reads from here */
+    FILE* out;
+    int client;      /* 0 = console, otherwise the server's client number */
+    int timing_on;   /* TIMING ON is per session */
+    OutBuf* rows;    /* buffered record listings, flushed to out */
+} Session;
+
+static Session console_session;
+static CMS_TLS Session* session = NULL;
+
+#ifdef __GNUC__
+__attribute__((format(printf, 1, 2)))
+#endif
+static void out_printf(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(session->out, fmt, ap);
+    va_end(ap);
+}
+
+/* Commands that only read the store hold db_lock shared, all others hold it
+ * exclusively. Readers may still build the lazy sort orders and trigram
+ * indexes, so those builds take index_lock; misc_lock covers the command
+ * history and the statistics counters. */
+static cms_rwlock db_lock = CMS_RWLOCK_INIT;
+static cms_mutex index_lock = CMS_MUTEX_INIT;
+static cms_mutex misc_lock = CMS_MUTEX_INIT;
+
 typedef struct {
     int id;
     char name[MAX_NAME];
@@ -45,27 +204,589 @@ typedef struct {
 } Student;
 
 typedef enum {
-    OP_NONE, OP_INSERT, OP_UPDATE, OP_DELETE
+    OP_NONE, OP_INSERT, OP_UPDATE, OP_DELETE, OP_GROUP, OP_IMPORT
 } OpType;
 
-typedef struct {
+enum { UF_NAME = 1, UF_PROG = 2, UF_MARK = 4 };   /* fields an OP_UPDATE changed */
+
+/* One step of history. INSERT/DELETE keep the whole record; UPDATE keeps
+   only the fields it changed, as before/after pairs. */
+typedef struct UndoEntry {
     OpType type;
-    Student before;
-    Student after;
-    int had_before;
+    int id;
+    int changed;               /* OP_UPDATE: UF_* bits */
+    float mark[2];             /* before, after (INSERT/DELETE: mark[0]) */
+    char* text;                /* name, programme; OP_UPDATE: before/after of each changed string */
+    struct UndoEntry* group;   /* OP_GROUP: the committed transaction's entries, oldest first */
+    int* ids;                  /* OP_IMPORT: IDs of the imported records */
+    float* marks;              /* OP_IMPORT once undone: their marks (text: name, programme of each) for REDO */
+    int count;                 /* entries in group / ids */
 } UndoEntry;
 
-static Student records[MAX_RECORDS];
+/* ---- Trigram index ----
+ * Maps every case-folded 3-byte window of a string to the list of keys
+ * (record IDs for names, programme IDs for programmes) whose string
+ * contains it. A substring query only verifies the keys listed under its
+ * rarest trigram instead of scanning every record. Lists are unordered;
+ * keys stay valid when records move, so deletes do not renumber them. */
+typedef struct {
+    uint32_t tri;   /* three folded bytes, 0 = empty bucket */
+    int n, cap;
+    int* keys;
+} TriList;
+
+typedef struct {
+    TriList* lists;
+    int bits;       /* capacity is 1<<bits */
+    int used;
+    int valid;      /* built lazily on the first search */
+} TriIndex;
+
+#define TRI_MAX (MAX_LINE)
+
+static TriIndex name_tri, prog_tri;
+
+static unsigned char fold_byte(char c) { return (unsigned char)tolower((unsigned char)c); }
+
+/* distinct trigrams of s, sorted; returns their count */
+static int tri_keys(const char* s, uint32_t* out) {
+    int n = 0;
+    size_t len = strlen(s);
+    for (size_t i=0; i+2<len && n<TRI_MAX; ++i) {
+        out[n++] = ((uint32_t)fold_byte(s[i]) << 16) | ((uint32_t)fold_byte(s[i+1]) << 8) | fold_byte(s[i+2]);
+    }
+    /* insertion sort + unique: names are short */
+    for (int i=1;i<n;++i) {
+        uint32_t t = out[i]; int j = i;
+        while (j>0 && out[j-1] > t) { out[j] = out[j-1]; --j; }
+        out[j] = t;
+    }
+    int u = 0;
+    for (int i=0;i<n;++i) if (u==0 || out[u-1] != out[i]) out[u++] = out[i];
+    return u;
+}
+
+static size_t tri_hash(uint32_t tri, int bits) {
+    return (size_t)((tri * 2654435769u) >> (32 - bits));
+}
+
+static TriList* tri_find(const TriIndex* ix, uint32_t tri) {
+    if (!ix->lists) return NULL;
+    size_t mask = ((size_t)1 << ix->bits) - 1;
+    for (size_t i = tri_hash(tri, ix->bits); ix->lists[i].tri; i = (i+1) & mask) {
+        if (ix->lists[i].tri == tri) return &ix->lists[i];
+    }
+    return NULL;
+}
+
+static int tri_grow(TriIndex* ix) {
+    int bits = ix->bits ? ix->bits+1 : 10;
+    TriList* t = (TriList*)calloc((size_t)1 << bits, sizeof(TriList));
+    if (!t) return 0;
+    size_t mask = ((size_t)1 << bits) - 1, old = ix->lists ? (size_t)1 << ix->bits : 0;
+    for (size_t i=0;i<old;++i) {
+        if (!ix->lists[i].tri) continue;
+        size_t j = tri_hash(ix->lists[i].tri, bits);
+        while (t[j].tri) j = (j+1) & mask;
+        t[j] = ix->lists[i];
+    }
+    free(ix->lists);
+    ix->lists = t; ix->bits = bits;
+    return 1;
+}
+
+/* the list for tri, created empty on first use; NULL when out of memory */
+static TriList* tri_list(TriIndex* ix, uint32_t tri) {
+    TriList* l = tri_find(ix, tri);
+    if (l) return l;
+    if ((size_t)(ix->used+1)*2 > ((size_t)1 << ix->bits) && !tri_grow(ix)) return NULL;
+    size_t mask = ((size_t)1 << ix->bits) - 1;
+    size_t i = tri_hash(tri, ix->bits);
+    while (ix->lists[i].tri) i = (i+1) & mask;
+    ix->lists[i].tri = tri;
+    ix->used++;
+    return &ix->lists[i];
+}
+
+static void tri_clear(TriIndex* ix) {
+    size_t cap = ix->lists ? (size_t)1 << ix->bits : 0;
+    for (size_t i=0;i<cap;++i) free(ix->lists[i].keys);
+    free(ix->lists);
+    ix->lists = NULL; ix->bits = 0; ix->used = 0; ix->valid = 0;
+}
+
+static int tri_add(TriIndex* ix, const char* s, int key) {
+    uint32_t tris[TRI_MAX];
+    int n = tri_keys(s, tris);
+    for (int t=0;t<n;++t) {
+        TriList* l = tri_list(ix, tris[t]);
+        if (!l) return 0;
+        if (l->n == l->cap) {
+            int cap = l->cap ? l->cap*2 : 4;
+            int* k = (int*)realloc(l->keys, sizeof(int)*(size_t)cap);
+            if (!k) return 0;
+            l->keys = k; l->cap = cap;
+        }
+        l->keys[l->n++] = key;
+    }
+    return 1;
+}
+
+static void tri_remove(TriIndex* ix, const char* s, int key) {
+    uint32_t tris[TRI_MAX];
+    int n = tri_keys(s, tris);
+    for (int t=0;t<n;++t) {
+        TriList* l = tri_find(ix, tris[t]);
+        if (!l) continue;
+        for (int j=0;j<l->n;++j) {
+            if (l->keys[j] == key) { l->keys[j] = l->keys[--l->n]; break; }
+        }
+    }
+}
+
+/* candidate keys for a folded query: the shortest list among its trigrams.
+   Returns the count (0 when some trigram never occurs), or -1 when the
+   query is shorter than a trigram and the caller has to scan. */
+static int tri_candidates(const TriIndex* ix, const char* key_lc, const int** out) {
+    uint32_t tris[TRI_MAX];
+    int n = tri_keys(key_lc, tris);
+    if (n == 0) return -1;
+    const TriList* best = NULL;
+    for (int t=0;t<n;++t) {
+        const TriList* l = tri_find(ix, tris[t]);
+        if (!l || l->n == 0) return 0;
+        if (!best || l->n < best->n) best = l;
+    }
+    *out = best->keys;
+    return best->n;
+}
+
+/* ---- Folded text search ----
+ * Names and programmes keep a lowercased shadow copy, written when the text
+ * is stored, so searches compare bytes as they are instead of folding every
+ * record per query. Shadow text is followed by at least FOLD_PAD readable
+ * bytes, which lets the kernel load whole vectors past the end of a string:
+ * it tests the key's first and last byte at 16 positions at once (32 with
+ * AVX2) and compares the whole key only where both match. */
+#define FOLD_PAD (MAX_NAME + 32)
+
+static void fold_text(char* dst, const char* s, size_t n) {
+    for (size_t i=0;i<n;++i) dst[i] = (char)fold_byte(s[i]);
+}
+
+#ifdef CMS_SSE2
+/* index of the lowest set bit of x (x != 0) */
+static int low_bit(unsigned x) {
+#ifdef __GNUC__
+    return __builtin_ctz(x);
+#else
+    int b = 0;
+    while (!(x & 1)) { x >>= 1; b++; }
+    return b;
+#endif
+}
+#endif
+
+/* does hay (folded shadow text) contain key (folded, n < MAX_NAME bytes)? */
+static int fold_contains(const char* hay, const char* key, size_t n) {
+    if (n == 0) return 1;
+#if defined(CMS_AVX2)
+    const __m256i first = _mm256_set1_epi8(key[0]), last = _mm256_set1_epi8(key[n-1]), zero = _mm256_setzero_si256();
+    for (const char* p = hay;; p += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)p);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p+n-1));
+        unsigned end = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero));
+        unsigned cand = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        if (end) cand &= (end & (0u-end)) - 1;   /* starts before the terminator */
+        for (; cand; cand &= cand-1) if (memcmp(p + low_bit(cand), key, n) == 0) return 1;
+        if (end) return 0;
+    }
+#elif defined(CMS_SSE2)
+    const __m128i first = _mm_set1_epi8(key[0]), last = _mm_set1_epi8(key[n-1]), zero = _mm_setzero_si128();
+    for (const char* p = hay;; p += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)p);
+        __m128i b = _mm_loadu_si128((const __m128i*)(p+n-1));
+        unsigned end = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero));
+        unsigned cand = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        if (end) cand &= (end & (0u-end)) - 1;   /* starts before the terminator */
+        for (; cand; cand &= cand-1) if (memcmp(p + low_bit(cand), key, n) == 0) return 1;
+        if (end) return 0;
+    }
+#else
+    return strstr(hay, key) != NULL;
+#endif
+}
+
+/* ---- Interned strings ----
+ * Programmes repeat heavily, so each distinct one is stored once in a
+ * dictionary and records keep its small integer ID. Names are packed
+ * back to back in one arena and records keep their byte offset. */
+static uint32_t str_hash(const char* s) {
+    uint32_t h = 2166136261u;
+    for (; *s; ++s) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static char** prog_str = NULL;     /* programme ID -> string */
+static char** prog_fold = NULL;    /* programme ID -> folded shadow (same allocation) */
+static int n_progs = 0;
+static int progs_cap = 0;
+static int* prog_table = NULL;     /* open addressing over programme IDs, -1 = empty */
+static int prog_table_bits = 0;
+
+static int prog_lookup(const char* s) {
+    if (!prog_table) return -1;
+    size_t mask = ((size_t)1 << prog_table_bits) - 1;
+    for (size_t i = str_hash(s) & mask; prog_table[i] >= 0; i = (i+1) & mask) {
+        if (strcmp(prog_str[prog_table[i]], s) == 0) return prog_table[i];
+    }
+    return -1;
+}
+
+static int prog_table_grow(void) {
+    int bits = prog_table_bits ? prog_table_bits+1 : 6;
+    int* t = (int*)malloc(sizeof(int) << bits);
+    if (!t) return 0;
+    size_t cap = (size_t)1 << bits, mask = cap-1;
+    for (size_t i=0;i<cap;++i) t[i] = -1;
+    for (int p=0;p<n_progs;++p) {
+        size_t i = str_hash(prog_str[p]) & mask;
+        while (t[i] >= 0) i = (i+1) & mask;
+        t[i] = p;
+    }
+    free(prog_table);
+    prog_table = t; prog_table_bits = bits;
+    return 1;
+}
+
+/* returns the programme's ID, adding it on first use; -1 when out of memory */
+static int prog_intern(const char* s) {
+    int p = prog_lookup(s);
+    if (p >= 0) return p;
+    if ((size_t)(n_progs+1)*2 > ((size_t)1 << prog_table_bits) && !prog_table_grow()) return -1;
+    if (n_progs == progs_cap) {
+        int cap = progs_cap ? progs_cap*2 : 16;
+        char** ps = (char**)realloc(prog_str, sizeof(char*)*(size_t)cap);
+        if (!ps) return -1;
+        prog_str = ps;
+        char** fs = (char**)realloc(prog_fold, sizeof(char*)*(size_t)cap);
+        if (!fs) return -1;
+        prog_fold = fs; progs_cap = cap;
+    }
+    size_t len = strlen(s);
+    char* copy = (char*)malloc(2*(len+1) + FOLD_PAD);
+    if (!copy) return -1;
+    memcpy(copy, s, len+1);
+    fold_text(copy+len+1, s, len+1);
+    memset(copy+2*(len+1), 0, FOLD_PAD);
+    prog_str[n_progs] = copy;
+    prog_fold[n_progs] = copy+len+1;
+    size_t mask = ((size_t)1 << prog_table_bits) - 1;
+    size_t i = str_hash(s) & mask;
+    while (prog_table[i] >= 0) i = (i+1) & mask;
+    prog_table[i] = n_progs;
+    if (prog_tri.valid && !tri_add(&prog_tri, copy, n_progs)) tri_clear(&prog_tri);
+    return n_progs++;
+}
+
+static void prog_dict_clear(void) {
+    for (int p=0;p<n_progs;++p) free(prog_str[p]);
+    n_progs = 0;
+    tri_clear(&prog_tri);
+    size_t cap = prog_table ? (size_t)1 << prog_table_bits : 0;
+    for (size_t i=0;i<cap;++i) prog_table[i] = -1;
+}
+
+static char* name_arena = NULL;
+static char* name_fold = NULL;     /* folded shadow of name_arena, same offsets, name_cap + FOLD_PAD bytes */
+static size_t name_used = 0;
+static size_t name_cap = 0;
+static size_t name_garbage = 0;    /* bytes of names no record points at any more */
+
+static int name_append(const char* s, uint32_t* off) {
+    size_t len = strlen(s)+1;
+    if (name_used + len > UINT32_MAX) return 0;
+    if (name_used + len > name_cap) {
+        size_t cap = name_cap ? name_cap : 4096;
+        while (cap < name_used + len) cap *= 2;
+        char* f = (char*)realloc(name_fold, cap + FOLD_PAD);
+        if (!f) return 0;
+        memset(f + name_used, 0, cap + FOLD_PAD - name_used);
+        name_fold = f;
+        char* a = (char*)realloc(name_arena, cap);
+        if (!a) return 0;
+        name_arena = a; name_cap = cap;
+    }
+    memcpy(name_arena + name_used, s, len);
+    fold_text(name_fold + name_used, s, len);
+    *off = (uint32_t)name_used;
+    name_used += len;
+    return 1;
+}
+
+/* record store: structure of arrays, one contiguous column per field,
+   growing together geometrically (no fixed ceiling). Scans that need one
+   field (e.g. SHOW SUMMARY over marks) stream only that column.
+   Student remains the row type used for parsing, undo and file formats. */
+static int* col_id = NULL;
+static float* col_mark = NULL;
+static uint32_t* col_name = NULL;  /* offset into name_arena */
+static uint32_t* col_prog = NULL;  /* programme ID */
 static int n_records = 0;
+static int records_cap = 0;
+static unsigned long store_epoch = 0;   /* bumped by every mutation; a background save compares it */
+
+static int columns_resize(int cap) {
+    int* ids = (int*)realloc(col_id, sizeof(int)*(size_t)cap);
+    if (ids) col_id = ids;
+    float* marks = (float*)realloc(col_mark, sizeof(float)*(size_t)cap);
+    if (marks) col_mark = marks;
+    uint32_t* names = (uint32_t*)realloc(col_name, sizeof(*col_name)*(size_t)cap);
+    if (names) col_name = names;
+    uint32_t* progs = (uint32_t*)realloc(col_prog, sizeof(*col_prog)*(size_t)cap);
+    if (progs) col_prog = progs;
+    if (!ids || !marks || !names || !progs) return 0;
+    records_cap = cap;
+    return 1;
+}
+
+static int records_reserve(int n) {
+    if (n <= records_cap) return 1;
+    int cap = records_cap ? records_cap : 16;
+    while (cap < n) {
+        if (cap > INT_MAX/2) { cap = INT_MAX; break; }
+        cap *= 2;
+    }
+    return columns_resize(cap);
+}
+
+/* give back slack after a load so memory follows the real record count */
+static void records_shrink_to_fit(void) {
+    if (records_cap <= 16 || n_records*2 > records_cap) return;
+    columns_resize(n_records < 16 ? 16 : n_records);
+}
+
+static const char* rec_name(int i) { return name_arena + col_name[i]; }
+static const char* rec_fold(int i) { return name_fold + col_name[i]; }
+static const char* rec_prog(int i) { return prog_str[col_prog[i]]; }
+
+static void store_get(int i, Student* out) {
+    out->id = col_id[i];
+    strncpy(out->name, rec_name(i), MAX_NAME-1); out->name[MAX_NAME-1] = 0;
+    strncpy(out->programme, rec_prog(i), MAX_PROG-1); out->programme[MAX_PROG-1] = 0;
+    out->mark = col_mark[i];
+}
+
+/* rewrite the arena with only the names records still point at */
+static void name_arena_compact(void) {
+    size_t cap = 0;
+    for (int i=0;i<n_records;++i) cap += strlen(rec_name(i))+1;
+    if (!cap) cap = 1;
+    char* a = (char*)malloc(cap);
+    char* f = (char*)malloc(cap + FOLD_PAD);
+    if (!a || !f) { free(a); free(f); return; }
+    size_t used = 0;
+    for (int i=0;i<n_records;++i) {
+        const char* nm = rec_name(i);
+        size_t len = strlen(nm)+1;
+        memcpy(a + used, nm, len);
+        memcpy(f + used, rec_fold(i), len);
+        col_name[i] = (uint32_t)used;
+        used += len;
+    }
+    memset(f + used, 0, cap + FOLD_PAD - used);
+    free(name_arena); free(name_fold);
+    name_arena = a; name_fold = f; name_cap = cap; name_used = used; name_garbage = 0;
+}
+
+static void name_maybe_compact(void) {
+    if (name_garbage > (1u<<20) && name_garbage*2 > name_used) name_arena_compact();
+}
+
+/* undo history: a ring of undo_cap (a power of two) entries starting at
+   undo_base. The first undo_n can be undone; the redo_n after them were
+   undone and can be reapplied until the next change. The oldest entries
+   are dropped once all of them hold more than undo_budget bytes. */
+static UndoEntry* undo_ring = NULL;
+static int undo_cap = 0, undo_base = 0;
+static int undo_n = 0, redo_n = 0;
+static size_t undo_bytes = 0;
+static size_t undo_budget = (size_t)1 << 20;
+#define UNDO_AT(i) undo_ring[(undo_base + (i)) & (undo_cap - 1)]
 
-static UndoEntry undo_stack[128];
-static int undo_top = 0;
+typedef enum { FMT_TEXT, FMT_BINARY, FMT_COMPACT, FMT_COMPACT_LZ } DbFormat;
+static const char* const format_note[] = { "", ", binary", ", compact", ", compact LZ" };   /* for the OPEN message */
 
 static char db_filename[260] = "";
+static DbFormat db_format = FMT_TEXT;   /* format SAVE writes; OPEN switches it to the file's format */
+static char journal_filename[272] = "";
 static char team_name[128] = "";
 
 // settings
 static int autosave_on = 0;
+static int cms_threads = 0;   /* worker threads for bulk work, 0 = one per CPU */
+
+static int worker_count(void) {
+    return cms_threads > 0 ? cms_threads : cms_cpu_count();
+}
+
+/* ---- Worker pool ----
+ * Bulk work (loading, name sorts, full-table scans) is cut into tasks
+ * numbered 0..n-1 and run by helper threads that stay parked between jobs.
+ * Each worker starts on an even share of the task numbers and takes them
+ * from the front; one that runs dry steals from the back of the largest
+ * share left. Tasks write their results by task number and callers merge
+ * in that order, so the output is the same for any thread count. A job
+ * submitted while the pool is busy (another --serve client, or a task that
+ * submits its own) runs on the caller's thread alone. */
+#define POOL_MAX 64
+
+typedef void (*pool_fn)(void* ctx, int task);
+
+typedef struct { int next, end; } PoolShare;   /* task numbers [next, end) */
+
+static cms_mutex pool_lock = CMS_MUTEX_INIT;   /* guards everything below */
+static cms_cond pool_wake = CMS_COND_INIT;     /* a new job or quit */
+static cms_cond pool_idle = CMS_COND_INIT;     /* the last helper finished */
+static cms_thread pool_threads[POOL_MAX];
+static unsigned pool_seen[POOL_MAX];           /* last job each helper took part in */
+static int pool_helpers = 0;                   /* the submitting thread is worker 0 */
+static int pool_busy = 0, pool_quit = 0, pool_working = 0;
+static unsigned pool_job = 0;
+static pool_fn pool_task_fn;
+static void* pool_task_ctx;
+static int pool_shares;
+static PoolShare pool_share[POOL_MAX];
+
+/* the next task for worker w, or -1 when none is left (under pool_lock) */
+static int pool_claim(int w) {
+    PoolShare* own = &pool_share[w];
+    if (own->next < own->end) return own->next++;
+    int victim = -1, most = 0;
+    for (int v=0; v<pool_shares; ++v) {
+        if (pool_share[v].end - pool_share[v].next > most) { most = pool_share[v].end - pool_share[v].next; victim = v; }
+    }
+    return victim < 0 ? -1 : --pool_share[victim].end;
+}
+
+static void pool_work(int w, pool_fn fn, void* ctx) {
+    for (;;) {
+        cms_mutex_lock(&pool_lock);
+        int t = pool_claim(w);
+        cms_mutex_unlock(&pool_lock);
+        if (t < 0) return;
+        fn(ctx, t);
+    }
+}
+
+static void* pool_helper(void* arg) {
+    int w = (int)(intptr_t)arg;
+    cms_mutex_lock(&pool_lock);
+    for (;;) {
+        while (!pool_quit && pool_seen[w] == pool_job) cms_cond_wait(&pool_wake, &pool_lock);
+        if (pool_quit) break;
+        pool_seen[w] = pool_job;
+        pool_fn fn = pool_task_fn;
+        void* ctx = pool_task_ctx;
+        cms_mutex_unlock(&pool_lock);
+        pool_work(w, fn, ctx);
+        cms_mutex_lock(&pool_lock);
+        if (--pool_working == 0) cms_cond_broadcast(&pool_idle);
+    }
+    cms_mutex_unlock(&pool_lock);
+    return NULL;
+}
+
+/* restarts the helpers so that there are n of them, or as many as could start (holds pool_busy) */
+static void pool_resize(int n) {
+    cms_mutex_lock(&pool_lock);
+    pool_quit = 1;
+    cms_cond_broadcast(&pool_wake);
+    cms_mutex_unlock(&pool_lock);
+    for (int k=1; k<=pool_helpers; ++k) cms_thread_join(&pool_threads[k]);
+    cms_mutex_lock(&pool_lock);
+    pool_quit = 0;
+    pool_helpers = 0;
+    for (int k=1; k<=n; ++k) {
+        pool_seen[k] = pool_job;
+        if (!cms_thread_start(&pool_threads[k], pool_helper, (void*)(intptr_t)k)) break;
+        pool_helpers = k;
+    }
+    cms_mutex_unlock(&pool_lock);
+}
+
+/* runs fn(ctx, 0..n-1) on worker_count() threads and returns when all are done */
+static void pool_run(int n, pool_fn fn, void* ctx) {
+    int want = worker_count();
+    if (want > POOL_MAX) want = POOL_MAX;
+    cms_mutex_lock(&pool_lock);
+    if (want <= 1 || n <= 1 || pool_busy) {
+        cms_mutex_unlock(&pool_lock);
+        for (int t=0; t<n; ++t) fn(ctx, t);
+        return;
+    }
+    pool_busy = 1;
+    int resize = pool_helpers != want-1;
+    cms_mutex_unlock(&pool_lock);
+    if (resize) pool_resize(want-1);
+
+    cms_mutex_lock(&pool_lock);
+    pool_shares = pool_helpers+1;
+    for (int w=0; w<pool_shares; ++w) {
+        pool_share[w].next = (int)((long long)n * w / pool_shares);
+        pool_share[w].end = (int)((long long)n * (w+1) / pool_shares);
+    }
+    pool_task_fn = fn;
+    pool_task_ctx = ctx;
+    pool_working = pool_helpers;
+    pool_job++;
+    cms_cond_broadcast(&pool_wake);
+    cms_mutex_unlock(&pool_lock);
+
+    pool_work(0, fn, ctx);
+
+    cms_mutex_lock(&pool_lock);
+    while (pool_working > 0) cms_cond_wait(&pool_idle, &pool_lock);
+    pool_busy = 0;
+    cms_mutex_unlock(&pool_lock);
+}
+
+/* Full-table scans run one pool task per SCAN_CHUNK slots. A task writes
+   the slots it picks from [lo, hi) to hits[lo..] and returns how many;
+   the runs are then closed up in slot order. */
+#define SCAN_CHUNK 16384
+
+typedef int (*chunk_scan)(const void* ctx, int lo, int hi, int* out);
+
+typedef struct {
+    chunk_scan scan;
+    const void* ctx;
+    int n;
+    int* hits;
+    int* counts;
+} ScanJob;
+
+static void scan_task(void* ctx, int task) {
+    ScanJob* j = (ScanJob*)ctx;
+    int lo = task*SCAN_CHUNK, hi = lo+SCAN_CHUNK < j->n ? lo+SCAN_CHUNK : j->n;
+    j->counts[task] = j->scan(j->ctx, lo, hi, j->hits+lo);
+}
+
+/* the slots of [0, n) that scan picks, in slot order, into hits (room for n); returns the count */
+static int scan_slots(int n, chunk_scan scan, const void* ctx, int* hits) {
+    int tasks = (n + SCAN_CHUNK-1) / SCAN_CHUNK;
+    int* counts = tasks > 1 && worker_count() > 1 ? (int*)malloc(sizeof(int)*(size_t)tasks) : NULL;
+    if (!counts) return scan(ctx, 0, n, hits);
+    ScanJob j = { scan, ctx, n, hits, counts };
+    pool_run(tasks, scan_task, &j);
+    int nh = 0;
+    for (int t=0; t<tasks; ++t) {
+        memmove(hits+nh, hits+(size_t)t*SCAN_CHUNK, sizeof(int)*(size_t)counts[t]);
+        nh += counts[t];
+    }
+    free(counts);
+    return nh;
+}
 
 // command history
 #define MAX_HISTORY 100
@@ -74,6 +795,7 @@ static int history_count = 0;
 
 static void history_add(const char* line) {
     if (!line || !line[0]) return;
+    cms_mutex_lock(&misc_lock);
     if (history_count < MAX_HISTORY) {
         strncpy(command_history[history_count], line, MAX_LINE-1);
         command_history[history_count][MAX_LINE-1] = '\0';
@@ -87,38 +809,349 @@ static void history_add(const char* line) {
         strncpy(command_history[MAX_HISTORY-1], line, MAX_LINE-1);
         command_history[MAX_HISTORY-1][MAX_LINE-1] = '\0';
     }
+    cms_mutex_unlock(&misc_lock);
 }
 
 static void cmd_history(void) {
+    cms_mutex_lock(&misc_lock);
     if (history_count == 0) {
-        printf("CMS: No commands in history.\n");
-        return;
+        out_printf("CMS: No commands in history.\n");
+    } else {
+        out_printf("CMS: Command history (most recent %d):\n", history_count);
+        for (int i = 0; i < history_count; ++i) {
+            out_printf("%2d: %s\n", i+1, command_history[i]);
+        }
+    }
+    cms_mutex_unlock(&misc_lock);
+}
+/* ---- Instrumentation (STATS, TIMING ON) ----
+ * Every command from the main loop is timed into a per-command histogram
+ * with decade buckets; file I/O and autosave keep their own counters. */
+typedef enum {
+    ST_OPEN, ST_SHOW_ALL, ST_SHOW_SUMMARY, ST_SHOW_PROG_SUMMARY, ST_SHOW_PROG,
+    ST_INSERT, ST_QUERY, ST_UPDATE, ST_DELETE, ST_FIND, ST_IMPORT, ST_EXPORT,
+    ST_SAVE, ST_UNDO, ST_TXN, ST_SET, ST_HISTORY, ST_STATS, ST_OTHER, ST_KINDS
+} StatKind;
+
+static const char* const stat_names[ST_KINDS] = {
+    "OPEN", "SHOW ALL", "SHOW SUMMARY", "SHOW PROGRAMME SUMMARY", "SHOW PROGRAMME",
+    "INSERT", "QUERY", "UPDATE", "DELETE", "FIND", "IMPORT", "EXPORT",
+    "SAVE", "UNDO/REDO", "BEGIN/COMMIT/ROLLBACK", "SET", "HISTORY", "STATS/TIMING", "other"
+};
+
+#define STAT_BUCKETS 7   /* <10us <100us <1ms <10ms <100ms <1s >=1s */
+
+typedef struct {
+    long calls;
+    double total_ms, max_ms;
+    long hist[STAT_BUCKETS];
+} CmdStat;
+
+static CmdStat stat_table[ST_KINDS];
+
+static struct {
+    long loads, saves, exports, imports, replays;
+    long long load_bytes, save_bytes, export_bytes, import_bytes, replay_bytes, journal_bytes;
+    long autosaves, autosave_compactions;
+    double autosave_ms, autosave_max_ms;
+} io_stats;
+
+static double cms_now_ms(void) {
+#ifdef _WIN32
+    LARGE_INTEGER f, c;
+    QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&c);
+    return (double)c.QuadPart * 1000.0 / (double)f.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+#endif
+}
+
+static void stats_note(StatKind k, double ms) {
+    cms_mutex_lock(&misc_lock);
+    CmdStat* s = &stat_table[k];
+    s->calls++;
+    s->total_ms += ms;
+    if (ms > s->max_ms) s->max_ms = ms;
+    int b = 0;
+    for (double limit = 0.01; b < STAT_BUCKETS-1 && ms >= limit; limit *= 10) b++;
+    s->hist[b]++;
+    cms_mutex_unlock(&misc_lock);
+}
+
+/* lexing is timed apart from the commands, so its share stays visible */
+static struct {
+    long lines;
+    double total_ms, max_ms;
+} parse_stats;
+
+static void parse_note(double ms) {
+    cms_mutex_lock(&misc_lock);
+    parse_stats.lines++;
+    parse_stats.total_ms += ms;
+    if (ms > parse_stats.max_ms) parse_stats.max_ms = ms;
+    cms_mutex_unlock(&misc_lock);
+}
+
+/* ---- Command lexer ----
+ * A line is read once, left to right, into a Command: the verb (and the
+ * SHOW/SET sub-word) is looked up in a keyword table addressed by a perfect
+ * hash, then KEY=value pairs fill one slot per key. Handlers read the slots
+ * instead of rescanning the line for every field. */
+typedef enum {
+    KW_NONE, KW_EXIT, KW_QUIT, KW_HELP, KW_OPEN, KW_SHOW, KW_INSERT, KW_QUERY, KW_UPDATE, KW_DELETE,
+    KW_FIND, KW_SET, KW_IMPORT, KW_EXPORT, KW_SAVE, KW_UNDO, KW_REDO, KW_BEGIN, KW_COMMIT, KW_ROLLBACK,
+    KW_HISTORY, KW_STATS, KW_TIMING, KW_ALL, KW_PROGRAMME, KW_SUMMARY, KW_AUTOSAVE, KW_FORMAT, KW_FSYNC,
+    KW_ID, KW_NAME, KW_MARK, KW_CONFIRM, KW_CSV, KW_JSONL, KW_TSV, KW_BIN, KW_WHERE, KW_AND, KW_BETWEEN,
+    KW_THREADS
+} Keyword;
+
+/* collision-free over the words below (first two letters, last letter, length);
+   a new keyword that collides shows up as a duplicate initializer */
+#define KW_HASH(c0, c1, cl, n) ((((c0)*38 + (c1)*9 + (cl)*3 + (n))) & 127)
+
+static const struct { const char* word; Keyword kw; } keywords[128] = {
+    [KW_HASH('E','X','T',4)] = {"EXIT", KW_EXIT},          [KW_HASH('Q','U','T',4)] = {"QUIT", KW_QUIT},
+    [KW_HASH('H','E','P',4)] = {"HELP", KW_HELP},          [KW_HASH('O','P','N',4)] = {"OPEN", KW_OPEN},
+    [KW_HASH('S','H','W',4)] = {"SHOW", KW_SHOW},          [KW_HASH('I','N','T',6)] = {"INSERT", KW_INSERT},
+    [KW_HASH('Q','U','Y',5)] = {"QUERY", KW_QUERY},        [KW_HASH('U','P','E',6)] = {"UPDATE", KW_UPDATE},
+    [KW_HASH('D','E','E',6)] = {"DELETE", KW_DELETE},      [KW_HASH('F','I','D',4)] = {"FIND", KW_FIND},
+    [KW_HASH('S','E','T',3)] = {"SET", KW_SET},            [KW_HASH('I','M','T',6)] = {"IMPORT", KW_IMPORT},
+    [KW_HASH('E','X','T',6)] = {"EXPORT", KW_EXPORT},      [KW_HASH('S','A','E',4)] = {"SAVE", KW_SAVE},
+    [KW_HASH('U','N','O',4)] = {"UNDO", KW_UNDO},          [KW_HASH('R','E','O',4)] = {"REDO", KW_REDO},
+    [KW_HASH('B','E','N',5)] = {"BEGIN", KW_BEGIN},        [KW_HASH('C','O','T',6)] = {"COMMIT", KW_COMMIT},
+    [KW_HASH('R','O','K',8)] = {"ROLLBACK", KW_ROLLBACK},  [KW_HASH('H','I','Y',7)] = {"HISTORY", KW_HISTORY},
+    [KW_HASH('S','T','S',5)] = {"STATS", KW_STATS},        [KW_HASH('T','I','G',6)] = {"TIMING", KW_TIMING},
+    [KW_HASH('A','L','L',3)] = {"ALL", KW_ALL},            [KW_HASH('P','R','E',9)] = {"PROGRAMME", KW_PROGRAMME},
+    [KW_HASH('S','U','Y',7)] = {"SUMMARY", KW_SUMMARY},    [KW_HASH('A','U','E',8)] = {"AUTOSAVE", KW_AUTOSAVE},
+    [KW_HASH('F','O','T',6)] = {"FORMAT", KW_FORMAT},      [KW_HASH('F','S','C',5)] = {"FSYNC", KW_FSYNC},
+    [KW_HASH('I','D','D',2)] = {"ID", KW_ID},              [KW_HASH('N','A','E',4)] = {"NAME", KW_NAME},
+    [KW_HASH('M','A','K',4)] = {"MARK", KW_MARK},          [KW_HASH('C','O','M',7)] = {"CONFIRM", KW_CONFIRM},
+    [KW_HASH('C','S','V',3)] = {"CSV", KW_CSV},            [KW_HASH('W','H','E',5)] = {"WHERE", KW_WHERE},
+    [KW_HASH('A','N','D',3)] = {"AND", KW_AND},            [KW_HASH('B','E','N',7)] = {"BETWEEN", KW_BETWEEN},
+    [KW_HASH('T','H','S',7)] = {"THREADS", KW_THREADS},    [KW_HASH('J','S','L',5)] = {"JSONL", KW_JSONL},
+    [KW_HASH('T','S','V',3)] = {"TSV", KW_TSV},            [KW_HASH('B','I','N',3)] = {"BIN", KW_BIN},
+};
+
+/* the keyword spelled (in any case) by s[0..n), or KW_NONE */
+static Keyword keyword_of(const char* s, size_t n) {
+    if (n < 2) return KW_NONE;
+    int c0 = toupper((unsigned char)s[0]), c1 = toupper((unsigned char)s[1]), cl = toupper((unsigned char)s[n-1]);
+    int h = KW_HASH(c0, c1, cl, (int)n);
+    const char* w = keywords[h].word;
+    if (!w || strlen(w) != n || strncasecmp(s, w, n) != 0) return KW_NONE;
+    return keywords[h].kw;
+}
+
+typedef enum {
+    CMD_UNKNOWN, CMD_EXIT, CMD_HELP, CMD_OPEN, CMD_SHOW_ALL, CMD_SHOW_SUMMARY, CMD_SHOW_PROG_SUMMARY,
+    CMD_SHOW_PROG, CMD_INSERT, CMD_QUERY, CMD_UPDATE, CMD_DELETE, CMD_FIND, CMD_IMPORT, CMD_EXPORT,
+    CMD_SAVE, CMD_UNDO, CMD_REDO, CMD_BEGIN, CMD_COMMIT, CMD_ROLLBACK, CMD_SET_AUTOSAVE, CMD_SET_FORMAT,
+    CMD_SET_FSYNC, CMD_SET_UNDO, CMD_SET_THREADS, CMD_HISTORY, CMD_STATS, CMD_TIMING, CMD_KINDS
+} CmdKind;
+
+/* which counter each command feeds */
+static const StatKind cmd_stat[CMD_KINDS] = {
+    ST_OTHER, ST_OTHER, ST_OTHER, ST_OPEN, ST_SHOW_ALL, ST_SHOW_SUMMARY, ST_SHOW_PROG_SUMMARY,
+    ST_SHOW_PROG, ST_INSERT, ST_QUERY, ST_UPDATE, ST_DELETE, ST_FIND, ST_IMPORT, ST_EXPORT,
+    ST_SAVE, ST_UNDO, ST_UNDO, ST_TXN, ST_TXN, ST_TXN, ST_SET, ST_SET,
+    ST_SET, ST_SET, ST_SET, ST_HISTORY, ST_STATS, ST_STATS
+};
+
+enum { KEY_ID, KEY_NAME, KEY_PROGRAMME, KEY_MARK, KEY_CONFIRM, KEY_CSV, KEY_JSONL, KEY_TSV, KEY_BIN, N_KEYS };   /* file keys last */
+
+typedef struct {
+    CmdKind kind;
+    const char* args;        /* the line after the verb words (OPEN's team, SHOW ALL's options, SET's value) */
+    const char* where;       /* the text after WHERE (SHOW WHERE, EXPORT ... WHERE), NULL without one */
+    const char* opts;        /* EXPORT's SORT BY / LIMIT / TOP text without a WHERE, NULL without any */
+    const char* val[N_KEYS]; /* KEY=value slots (first occurrence wins), NULL when absent */
+    char vals[MAX_LINE];     /* backing store for val[] */
+    size_t vals_used;
+} Command;
+
+/* reads the word at *p (up to a space or '=') and skips the spaces after it;
+   a word followed by '=' is a key, so *p is left on it */
+static Keyword lex_word(const char** p) {
+    const char* s = *p;
+    const char* e = s;
+    while (*e && *e != '=' && !isspace((unsigned char)*e)) e++;
+    Keyword kw = keyword_of(s, (size_t)(e-s));
+    if (*e == '=') return kw;
+    while (isspace((unsigned char)*e)) e++;
+    *p = e;
+    return kw;
+}
+
+/* the KEY= starting at q, if any: its slot and where its value begins */
+static int lex_key(const char* q, int* key, const char** val) {
+    const char* e = q;
+    while (isalpha((unsigned char)*e)) e++;
+    if (*e != '=') return 0;
+    switch (keyword_of(q, (size_t)(e-q))) {
+    case KW_ID: *key = KEY_ID; break;
+    case KW_NAME: *key = KEY_NAME; break;
+    case KW_PROGRAMME: *key = KEY_PROGRAMME; break;
+    case KW_MARK: *key = KEY_MARK; break;
+    case KW_CONFIRM: *key = KEY_CONFIRM; break;
+    case KW_CSV: *key = KEY_CSV; break;
+    case KW_JSONL: *key = KEY_JSONL; break;
+    case KW_TSV: *key = KEY_TSV; break;
+    case KW_BIN: *key = KEY_BIN; break;
+    default: return 0;
+    }
+    *val = e+1;
+    return 1;
+}
+
+static void lex_store(Command* c, int key, const char* from, const char* to, int trim_end) {
+    if (c->val[key]) return;
+    if (trim_end) while (to > from && isspace((unsigned char)to[-1])) to--;
+    size_t len = (size_t)(to-from);
+    if (c->vals_used + len + 1 > sizeof(c->vals)) return;
+    char* v = c->vals + c->vals_used;
+    memcpy(v, from, len);
+    v[len] = '\0';
+    c->vals_used += len + 1;
+    c->val[key] = v;
+}
+
+/* SORT, LIMIT, OFFSET or TOP as a word at q: the start of the display options
+   after EXPORT's file or a WHERE predicate */
+static int lex_export_opts(const char* q) {
+    static const char* const words[] = { "SORT", "LIMIT", "OFFSET", "TOP" };
+    for (int k=0;k<4;++k) {
+        size_t n = strlen(words[k]);
+        if (strncasecmp(q, words[k], n) == 0 && (!q[n] || isspace((unsigned char)q[n]))) return 1;
+    }
+    return 0;
+}
+
+/* One pass over a trimmed line. A quoted value runs to the next quote (none:
+   the key counts as missing); a bare value runs to the next ID=, NAME=,
+   PROGRAMME=, MARK= or CONFIRM= that starts a word, so it may hold spaces. */
+static void lex_command(const char* line, Command* c) {
+    memset(c->val, 0, sizeof(c->val));
+    c->vals_used = 0;
+    c->where = NULL;
+    c->opts = NULL;
+    const char* p = line;
+    const char* word;
+    Keyword verb = lex_word(&p), sub;
+    switch (verb) {
+    case KW_EXIT: case KW_QUIT: c->kind = CMD_EXIT; break;
+    case KW_HELP: c->kind = CMD_HELP; break;
+    case KW_OPEN: c->kind = CMD_OPEN; break;
+    case KW_INSERT: c->kind = CMD_INSERT; break;
+    case KW_QUERY: c->kind = CMD_QUERY; break;
+    case KW_UPDATE: c->kind = CMD_UPDATE; break;
+    case KW_DELETE: c->kind = CMD_DELETE; break;
+    case KW_FIND: c->kind = CMD_FIND; break;
+    case KW_IMPORT: c->kind = CMD_IMPORT; break;
+    case KW_EXPORT: c->kind = CMD_EXPORT; break;
+    case KW_SAVE: c->kind = CMD_SAVE; break;
+    case KW_UNDO: c->kind = CMD_UNDO; break;
+    case KW_REDO: c->kind = CMD_REDO; break;
+    case KW_BEGIN: c->kind = CMD_BEGIN; break;
+    case KW_COMMIT: c->kind = CMD_COMMIT; break;
+    case KW_ROLLBACK: c->kind = CMD_ROLLBACK; break;
+    case KW_HISTORY: c->kind = CMD_HISTORY; break;
+    case KW_STATS: c->kind = CMD_STATS; break;
+    case KW_TIMING: c->kind = CMD_TIMING; break;
+    case KW_SHOW:
+        word = p;
+        sub = lex_word(&p);
+        if (sub == KW_ALL) c->kind = CMD_SHOW_ALL;
+        else if (sub == KW_WHERE && p != word) {   /* the predicate is not KEY=value text */
+            c->kind = CMD_SHOW_ALL;
+            c->where = p;
+            c->args = "";
+            return;
+        }
+        else if (sub == KW_SUMMARY) c->kind = CMD_SHOW_SUMMARY;
+        else if (sub == KW_PROGRAMME) {
+            const char* q = p;
+            if (p != word && lex_word(&q) == KW_SUMMARY && q != p) { c->kind = CMD_SHOW_PROG_SUMMARY; p = q; }
+            else c->kind = CMD_SHOW_PROG;
+        } else c->kind = CMD_UNKNOWN;
+        break;
+    case KW_SET:
+        sub = lex_word(&p);
+        c->kind = sub == KW_AUTOSAVE ? CMD_SET_AUTOSAVE : sub == KW_FORMAT ? CMD_SET_FORMAT
+                : sub == KW_FSYNC ? CMD_SET_FSYNC : sub == KW_UNDO ? CMD_SET_UNDO
+                : sub == KW_THREADS ? CMD_SET_THREADS : CMD_UNKNOWN;
+        break;
+    default:
+        c->kind = CMD_UNKNOWN;
+        break;
     }
-    printf("CMS: Command history (most recent %d):\n", history_count);
-    for (int i = 0; i < history_count; ++i) {
-        printf("%2d: %s\n", i+1, command_history[i]);
+    c->args = p;
+
+    int open = -1;             /* slot of a bare value still being read */
+    const char* open_at = NULL;
+    const char* q = p;
+    int at_word = 1;
+    while (*q) {
+        int key;
+        const char* v;
+        if (c->kind == CMD_EXPORT && (at_word || isspace((unsigned char)q[-1]))) {
+            const char* w = q;
+            if (lex_word(&w) == KW_WHERE && w != q) {   /* EXPORT's row filter ends the KEY=value pairs */
+                c->where = w;
+                break;
+            }
+            if (lex_export_opts(q)) { c->opts = q; break; }   /* and so do SORT BY, LIMIT, OFFSET and TOP */
+        }
+        if ((at_word || isspace((unsigned char)q[-1])) && lex_key(q, &key, &v) && (open < 0 || key < KEY_CSV)) {
+            if (open >= 0) { lex_store(c, open, open_at, q, 1); open = -1; }
+            if (*v == '"') {
+                const char* end = strchr(v+1, '"');
+                if (end) { lex_store(c, key, v+1, end, 0); q = end+1; at_word = 1; }
+                else { q = v+1; at_word = 0; }
+            } else {
+                open = key; open_at = v; q = v; at_word = 0;
+            }
+            continue;
+        }
+        q++;
+        at_word = 0;
     }
+    if (open >= 0) lex_store(c, open, open_at, q, 1);
+}
+
+/* copies a slot like a bounded strcpy; 0 when the key was not given */
+static int cmd_value(const Command* c, int key, char* out, size_t outsz) {
+    if (!c->val[key]) return 0;
+    snprintf(out, outsz, "%s", c->val[key]);
+    return 1;
 }
 
+/* first word of s equals w, ignoring case */
+static int word_is(const char* s, const char* w) {
+    size_t n = strlen(w);
+    return strncasecmp(s, w, n) == 0 && (!s[n] || isspace((unsigned char)s[n]));
+}
 
 static void print_declaration(void) {
-    printf("\nDeclaration\n");
-    printf("SIT's policy on copying does not allow the students to copy source code as well as assessment solutions\n");
-    printf("from another person AI or other places. It is the students' responsibility to guarantee that their\n");
-    printf("assessment solutions are their own work. Meanwhile, the students must also ensure that their work is\n");
-    printf("not accessible by others. Where such plagiarism is detected, both of the assessments involved will\n");
-    printf("receive ZERO mark.\n\n");
-    printf("We hereby declare that:\n");
-    printf("- We fully understand and agree to the abovementioned plagiarism policy.\n");
-    printf("- We did not copy any code from others or from other places.\n");
-    printf("- We did not share our codes with others or upload to any other places for public access and will not do that in the future.\n");
-    printf("- We agree that our project will receive Zero mark if there is any plagiarism detected.\n");
-    printf("- We agree that we will not disclose any information or material of the group project to others or upload to any other places for public access.\n");
-    printf("- We agree that we did not copy any code directly from AI generated sources\n\n");
-    printf("Declared by: Group Name: P10-09\n");
-    printf("Team members:\n");
-    printf("1. David Yong Jing Xiang\n2. Amal Nadiy\n3. Lim Kai Hin\n4. Liaw Jun De\n");
-    printf("Date: (please insert the date when you submit your group project)\n\n");
+    out_printf("\nDeclaration\n");
+    out_printf("SIT's policy on copying does not allow the students to copy source code as well as assessment solutions\n");
+    out_printf("from another person AI or other places. It is the students' responsibility to guarantee that their\n");
+    out_printf("assessment solutions are their own work. Meanwhile, the students must also ensure that their work is\n");
+    out_printf("not accessible by others. Where such plagiarism is detected, both of the assessments involved will\n");
+    out_printf("receive ZERO mark.\n\n");
+    out_printf("We hereby declare that:\n");
+    out_printf("- We fully understand and agree to the abovementioned plagiarism policy.\n");
+    out_printf("- We did not copy any code from others or from other places.\n");
+    out_printf("- We did not share our codes with others or upload to any other places for public access and will not do that in the future.\n");
+    out_printf("- We agree that our project will receive Zero mark if there is any plagiarism detected.\n");
+    out_printf("- We agree that we will not disclose any information or material of the group project to others or upload to any other places for public access.\n");
+    out_printf("- We agree that we did not copy any code directly from AI generated sources\n\n");
+    out_printf("Declared by: Group Name: P10-09\n");
+    out_printf("Team members:\n");
+    out_printf("1. David Yong Jing Xiang\n2. Amal Nadiy\n3. Lim Kai Hin\n4. Liaw Jun De\n");
+    out_printf("Date: (please insert the date when you submit your group project)\n\n");
 }
 
 static void trim(char* s) {
@@ -129,10 +1162,6 @@ static void trim(char* s) {
     while (end>=0 && isspace((unsigned char)s[end])) { s[end]='\0'; end--; }
 }
 
-static void strtoupper_inplace(char* s) {
-    for (; *s; ++s) *s = (char)toupper((unsigned char)*s);
-}
-
 static void normalise_caps(char* s) {
     int new_word = 1;
     for (char* p = s; *p; ++p) {
@@ -150,242 +1179,3026 @@ static void normalise_caps(char* s) {
     }
 }
 
+/* ---- Buffered output ----
+ * Record listings and file writers format rows by hand into a 64 KB
+ * buffer and hand it to stdio in one fwrite, instead of one printf per
+ * row. The formatters reproduce printf's %-W.Ps, %07d, %d and %W.2f
+ * byte for byte. Flush before mixing in printf calls. */
+#define OUT_BUF_SIZE (64*1024)
+#define OUT_ROW_MAX  (MAX_LINE)   /* room reserved per row; rows are far shorter */
+
+struct OutBuf {
+    FILE* fp;      /* NULL = stdout */
+    size_t len;
+    char buf[OUT_BUF_SIZE];
+};
+
+static OutBuf console_rows;   /* the console session's SHOW ALL / FIND / QUERY rows */
+
+static int out_flush(OutBuf* o) {
+    size_t n = o->len;
+    o->len = 0;
+    return n == 0 || fwrite(o->buf, 1, n, o->fp ? o->fp : stdout) == n;
+}
+
+/* pointer to at least OUT_ROW_MAX free bytes; commit with out_commit */
+static char* out_room(OutBuf* o) {
+    if (o->len + OUT_ROW_MAX > OUT_BUF_SIZE) out_flush(o);
+    return o->buf + o->len;
+}
+
+static void out_commit(OutBuf* o, const char* end) { o->len = (size_t)(end - o->buf); }
+
+/* %-<width>.<prec>s (prec < 0: whole string) */
+static char* fmt_str(char* p, const char* s, int width, int prec) {
+    int n = 0;
+    while (s[n] && (prec < 0 || n < prec)) { p[n] = s[n]; n++; }
+    p += n;
+    while (n++ < width) *p++ = ' ';
+    return p;
+}
+
+/* %0<width>d (width 0: plain %d) */
+static char* fmt_int(char* p, int v, int width) {
+    char tmp[16];
+    int n = 0;
+    unsigned int u = v < 0 ? 0u - (unsigned int)v : (unsigned int)v;
+    do { tmp[n++] = (char)('0' + u % 10); u /= 10; } while (u);
+    if (v < 0) { *p++ = '-'; width--; }
+    for (int z = n; z < width; ++z) *p++ = '0';
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+/* %<width>.2f of a float mark. The float times 100 is exact in a double,
+   so rounding it to an integer (ties to even, like printf) is exact too. */
+static char* fmt_mark(char* p, float m, int width) {
+    uint32_t bits; memcpy(&bits, &m, sizeof(bits));
+    int neg = (int)(bits >> 31);
+    double v = (double)m * 100.0;
+    if (neg) v = -v;
+    if (!(v < 1e15)) return p + sprintf(p, "%*.2f", width, m);   /* inf, nan, huge */
+    unsigned long long r = (unsigned long long)v;
+    double frac = v - (double)r;
+    if (frac > 0.5 || (frac == 0.5 && (r & 1))) r++;
+    char tmp[24];
+    int n = 0;
+    tmp[n++] = (char)('0' + r % 10); r /= 10;
+    tmp[n++] = (char)('0' + r % 10); r /= 10;
+    tmp[n++] = '.';
+    do { tmp[n++] = (char)('0' + r % 10); r /= 10; } while (r);
+    if (neg) tmp[n++] = '-';
+    for (int pad = n; pad < width; ++pad) *p++ = ' ';
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+/* comparators over record slots (int indices into the columns).
+   ID and MARK tie-break by ID; PROGRAMME and NAME keep slot (insertion)
+   order among equal keys, so every order is total and deterministic. */
+static int cmp_slot(int a, int b) { return (a > b) - (a < b); }
+
+static int cmp_int_asc(const void* a, const void* b) {
+    return cmp_slot(*(const int*)a, *(const int*)b);
+}
+
 static int cmp_id_asc(const void* a, const void* b) {
-    const Student* x = (const Student*)a;
-    const Student* y = (const Student*)b;
-    return (x->id > y->id) - (x->id < y->id);
+    int x = col_id[*(const int*)a];
+    int y = col_id[*(const int*)b];
+    if (x != y) return (x > y) - (x < y);
+    return cmp_slot(*(const int*)a, *(const int*)b);   /* a tombstone and its re-inserted ID */
 }
-static int cmp_id_desc(const void* a, const void* b) { return -cmp_id_asc(a,b); }
 
 static int cmp_mark_asc(const void* a, const void* b) {
-    const Student* x = (const Student*)a;
-    const Student* y = (const Student*)b;
-    if (x->mark < y->mark) return -1;
-    if (x->mark > y->mark) return 1;
+    float x = col_mark[*(const int*)a];
+    float y = col_mark[*(const int*)b];
+    if (x < y) return -1;
+    if (x > y) return 1;
     return cmp_id_asc(a,b);
 }
-static int cmp_mark_desc(const void* a, const void* b) { return -cmp_mark_asc(a,b); }
 
 static int cmp_programme_asc(const void* a, const void* b) {
-    const Student* x = (const Student*)a;
-    const Student* y = (const Student*)b;
-    return strcmp(x->programme, y->programme);
+    uint32_t x = col_prog[*(const int*)a], y = col_prog[*(const int*)b];
+    int c = x == y ? 0 : strcmp(prog_str[x], prog_str[y]);
+    return c ? c : cmp_slot(*(const int*)a, *(const int*)b);
 }
-static int cmp_programme_desc(const void* a, const void* b) { return -cmp_programme_asc(a,b); }
-
 
 static int cmp_name_asc(const void* a, const void* b) {
-    const Student* x = (const Student*)a;
-    const Student* y = (const Student*)b;
-    return strcmp(x->name, y->name);
+    int c = strcmp(rec_name(*(const int*)a), rec_name(*(const int*)b));
+    return c ? c : cmp_slot(*(const int*)a, *(const int*)b);
 }
-static int cmp_name_desc(const void* a, const void* b) { return -cmp_name_asc(a,b); }
 
+/* ---- Sort orders ----
+ * One persistent permutation of slots per SORT BY key. It is built the
+ * first time that key is used and from then on every mutation keeps it
+ * sorted (binary search + memmove), so SHOW ALL SORT BY ... with LIMIT or
+ * TOP reads a page straight off the order without copying or sorting. */
+typedef enum { SORT_ID, SORT_MARK, SORT_PROGRAMME, SORT_NAME, SORT_KEYS } SortKey;
 
-static int find_index_by_id(int id) {
-    for (int i=0;i<n_records;++i) if (records[i].id==id) return i;
-    return -1;
-}
+typedef struct {
+    int* pos;    /* slots in ascending key order */
+    int cap;
+    int valid;   /* 0 until first use (or after OPEN) */
+} SortOrder;
 
-static int parse_between(const char* line, const char* key, char* out, size_t outsz) {
-    const char* p = line;
-    size_t klen = strlen(key);
-    while (*p) {
-        if (strncasecmp(p, key, klen)==0 && p[klen]=='=') {
-            p += klen+1;
-            if (*p=='\"') {
-                p++;
-                const char* q = strchr(p, '\"');
-                if (!q) return 0;
-                size_t len = (size_t)(q-p); if (len>=outsz) len=outsz-1;
-                memcpy(out,p,len); out[len]='\0'; return 1;
-            } else {
-                const char* q = p;
-                while (*q) {
-                    if (strncasecmp(q," ID=",4)==0||strncasecmp(q," NAME=",6)==0||
-                        strncasecmp(q," PROGRAMME=",11)==0||strncasecmp(q," MARK=",6)==0) break;
-                    q++;
-                }
-                while (q>p && isspace((unsigned char)q[-1])) q--;
-                size_t len=(size_t)(q-p); if (len>=outsz) len=outsz-1;
-                memcpy(out,p,len); out[len]='\0'; return 1;
-            }
-        }
-        p++;
+static SortOrder sort_orders[SORT_KEYS];
+
+static int (*const sort_cmp[SORT_KEYS])(const void*, const void*) = {
+    cmp_id_asc, cmp_mark_asc, cmp_programme_asc, cmp_name_asc
+};
+
+/* first position in pos[0..n) whose slot does not sort before `slot` */
+static int sort_order_lower_bound(SortKey k, int slot, int n) {
+    const int* pos = sort_orders[k].pos;
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = lo + (hi-lo)/2;
+        if (sort_cmp[k](&pos[mid], &slot) < 0) lo = mid+1; else hi = mid;
     }
-    return 0;
+    return lo;
 }
 
-static int load_db(const char* filename) {
-    FILE* f = fopen(filename, "r");
+/* add a slot to an order holding `count_before` slots; its key values must already be in the columns */
+static int sort_order_insert(SortKey k, int slot, int count_before) {
+    SortOrder* o = &sort_orders[k];
+    if (count_before+1 > o->cap) {
+        int cap = o->cap ? o->cap*2 : 16;
+        while (cap < count_before+1) cap *= 2;
+        int* p = (int*)realloc(o->pos, sizeof(int)*(size_t)cap);
+        if (!p) { o->valid = 0; return 0; }
+        o->pos = p; o->cap = cap;
+    }
+    int at = sort_order_lower_bound(k, slot, count_before);
+    memmove(o->pos+at+1, o->pos+at, sizeof(int)*(size_t)(count_before-at));
+    o->pos[at] = slot;
+    return 1;
+}
+
+/* call while the slot still holds the key values it was inserted with (order holds n_records slots) */
+static void sort_order_remove(SortKey k, int slot) {
+    SortOrder* o = &sort_orders[k];
+    int at = sort_order_lower_bound(k, slot, n_records);
+    if (at >= n_records || o->pos[at] != slot) { o->valid = 0; return; }
+    memmove(o->pos+at, o->pos+at+1, sizeof(int)*(size_t)(n_records-at-1));
+}
+
+/* ---- Sort engine: building a whole order ----
+ * IDs and marks are LSD radix sorts of (key, slot) pairs; programmes are a
+ * counting sort by the rank of the programme string; names are (8-byte
+ * prefix, slot) pairs sorted in chunks on every worker thread, then merged
+ * pairwise in parallel. Each is stable over ascending slots (or, for marks,
+ * over the ID order), which reproduces the comparators' tie-breaks. */
+#define SORT_PAR_MIN 65536   /* fewer names than this sort on one thread */
+
+/* stable radix sort of slot[] by key[]: keys are rebased to their minimum,
+   then sorted 11 bits per pass over only the bits that vary. 0 when out of memory */
+#define RADIX_BITS 11
+static int radix_sort(uint32_t* key, int* slot, int n) {
+    if (n < 2) return 1;
+    uint32_t lo = key[0], hi = key[0];
+    for (int i=1;i<n;++i) { if (key[i] < lo) lo = key[i]; if (key[i] > hi) hi = key[i]; }
+    if (lo == hi) return 1;
+    for (int i=0;i<n;++i) key[i] -= lo;
+    int bits = 0;
+    for (uint32_t span = hi-lo; span; span >>= 1) bits++;
+    uint32_t* kbuf = (uint32_t*)malloc(sizeof(uint32_t)*(size_t)n);
+    int* sbuf = (int*)malloc(sizeof(int)*(size_t)n);
+    int* count = (int*)malloc(sizeof(int)*((1u << RADIX_BITS) + 1));
+    if (!kbuf || !sbuf || !count) { free(kbuf); free(sbuf); free(count); return 0; }
+    uint32_t *k = key, *k2 = kbuf;
+    int *sl = slot, *s2 = sbuf;
+    const uint32_t mask = (1u << RADIX_BITS) - 1;
+    for (int shift=0; shift<bits; shift+=RADIX_BITS) {
+        memset(count, 0, sizeof(int)*((1u << RADIX_BITS) + 1));
+        for (int i=0;i<n;++i) count[((k[i] >> shift) & mask) + 1]++;
+        for (uint32_t d=0; d<mask+1; ++d) count[d+1] += count[d];
+        for (int i=0;i<n;++i) {
+            int at = count[(k[i] >> shift) & mask]++;
+            k2[at] = k[i]; s2[at] = sl[i];
+        }
+        uint32_t* tk = k; k = k2; k2 = tk;
+        int* ts = sl; sl = s2; s2 = ts;
+    }
+    if (sl != slot) memcpy(slot, sl, sizeof(int)*(size_t)n);
+    free(kbuf); free(sbuf); free(count);
+    return 1;
+}
+
+/* order-preserving bits of a mark (-0 and +0 compare equal, so both map to +0) */
+static uint32_t mark_key(float m) {
+    union { float f; uint32_t u; } v;
+    v.f = m == 0.0f ? 0.0f : m;
+    return (v.u & 0x80000000u) ? ~v.u : v.u | 0x80000000u;
+}
+
+static int sort_by_id(int* pos, uint32_t* key) {
+    for (int i=0;i<n_records;++i) { pos[i] = i; key[i] = (uint32_t)col_id[i] ^ 0x80000000u; }
+    return radix_sort(key, pos, n_records);
+}
+
+/* marks tie-break by ID: radix the ID order by mark */
+static int sort_by_mark(int* pos, uint32_t* key) {
+    if (sort_orders[SORT_ID].valid) memcpy(pos, sort_orders[SORT_ID].pos, sizeof(int)*(size_t)n_records);
+    else if (!sort_by_id(pos, key)) return 0;
+    for (int i=0;i<n_records;++i) key[i] = mark_key(col_mark[pos[i]]);
+    return radix_sort(key, pos, n_records);
+}
+
+static int cmp_prog_str(const void* a, const void* b) {
+    return strcmp(prog_str[*(const int*)a], prog_str[*(const int*)b]);
+}
+
+static int sort_by_programme(int* pos) {
+    int* by_name = (int*)malloc(sizeof(int)*(size_t)(n_progs+1));
+    int* rank = (int*)malloc(sizeof(int)*(size_t)(n_progs+1));
+    int* count = (int*)calloc((size_t)n_progs+1, sizeof(int));
+    if (!by_name || !rank || !count) { free(by_name); free(rank); free(count); return 0; }
+    for (int p=0;p<n_progs;++p) by_name[p] = p;
+    qsort(by_name, (size_t)n_progs, sizeof(int), cmp_prog_str);
+    for (int r=0;r<n_progs;++r) rank[by_name[r]] = r;
+    for (int i=0;i<n_records;++i) count[rank[col_prog[i]]+1]++;
+    for (int r=1;r<n_progs;++r) count[r] += count[r-1];
+    for (int i=0;i<n_records;++i) pos[count[rank[col_prog[i]]]++] = i;
+    free(by_name); free(rank); free(count);
+    return 1;
+}
+
+typedef struct {
+    uint64_t pre;   /* first 8 bytes of the name, big-endian, zero padded */
+    int slot;
+} NameKey;
+
+static int cmp_name_key(const void* a, const void* b) {
+    const NameKey* x = (const NameKey*)a;
+    const NameKey* y = (const NameKey*)b;
+    if (x->pre != y->pre) return x->pre < y->pre ? -1 : 1;
+    if ((x->pre & 255) != 0) {   /* both names run past the prefix */
+        int c = strcmp(rec_name(x->slot)+8, rec_name(y->slot)+8);
+        if (c) return c;
+    }
+    return cmp_slot(x->slot, y->slot);
+}
+
+typedef struct {
+    NameKey* src;
+    NameKey* dst;   /* NULL: sort src[lo, hi) in place */
+    int lo, mid, hi;
+} NameSortJob;
+
+static void name_sort_task(void* ctx, int task) {
+    NameSortJob* j = (NameSortJob*)ctx + task;
+    if (!j->dst) {
+        qsort(j->src + j->lo, (size_t)(j->hi - j->lo), sizeof(NameKey), cmp_name_key);
+        return;
+    }
+    int a = j->lo, b = j->mid, w = j->lo;
+    while (a < j->mid && b < j->hi) j->dst[w++] = cmp_name_key(&j->src[b], &j->src[a]) < 0 ? j->src[b++] : j->src[a++];
+    while (a < j->mid) j->dst[w++] = j->src[a++];
+    while (b < j->hi) j->dst[w++] = j->src[b++];
+}
+
+static int sort_by_name(int* pos) {
+    int n = n_records;
+    NameKey* keys = (NameKey*)malloc(sizeof(NameKey)*(size_t)(n ? n : 1));
+    NameKey* tmp = (NameKey*)malloc(sizeof(NameKey)*(size_t)(n ? n : 1));
+    if (!keys || !tmp) { free(keys); free(tmp); return 0; }
+    for (int i=0;i<n;++i) {
+        const unsigned char* nm = (const unsigned char*)rec_name(i);
+        uint64_t pre = 0;
+        int j = 0;
+        for (; j<8 && nm[j]; ++j) pre = pre << 8 | nm[j];
+        keys[i].pre = pre << (8*(8-j));
+        keys[i].slot = i;
+    }
+    int runs = n < SORT_PAR_MIN ? 1 : worker_count();
+    if (runs > POOL_MAX) runs = POOL_MAX;
+    if (runs < 1) runs = 1;
+    int bound[POOL_MAX+1];
+    NameSortJob jobs[POOL_MAX];
+    for (int r=0;r<=runs;++r) bound[r] = (int)((long long)n * r / runs);
+    for (int r=0;r<runs;++r) { jobs[r].src = keys; jobs[r].dst = NULL; jobs[r].lo = bound[r]; jobs[r].hi = bound[r+1]; }
+    pool_run(runs, name_sort_task, jobs);
+    while (runs > 1) {   /* merge neighbouring runs; an odd one out is copied along */
+        int nj = 0;
+        for (int r=0;r<runs;r+=2) {
+            NameSortJob* j = &jobs[nj];
+            j->src = keys; j->dst = tmp; j->lo = bound[r];
+            j->mid = bound[r+1 <= runs ? r+1 : runs];
+            j->hi = bound[r+2 <= runs ? r+2 : runs];
+            bound[nj++] = j->lo;
+        }
+        bound[nj] = n;
+        pool_run(nj, name_sort_task, jobs);
+        NameKey* t = keys; keys = tmp; tmp = t;
+        runs = nj;
+    }
+    for (int i=0;i<n;++i) pos[i] = keys[i].slot;
+    free(keys); free(tmp);
+    return 1;
+}
+
+/* returns the ascending order for key k, building it on first use */
+static const int* sort_order_build(SortKey k) {
+    SortOrder* o = &sort_orders[k];
+    if (o->valid) return o->pos;
+    if (n_records > o->cap) {
+        int* p = (int*)realloc(o->pos, sizeof(int)*(size_t)n_records);
+        if (!p) return NULL;
+        o->pos = p; o->cap = n_records;
+    }
+    uint32_t* key = NULL;
+    if (k == SORT_ID || k == SORT_MARK) {
+        key = (uint32_t*)malloc(sizeof(uint32_t)*(size_t)(n_records ? n_records : 1));
+        if (!key) return NULL;
+    }
+    int ok = k == SORT_ID ? sort_by_id(o->pos, key)
+           : k == SORT_MARK ? sort_by_mark(o->pos, key)
+           : k == SORT_PROGRAMME ? sort_by_programme(o->pos)
+           : sort_by_name(o->pos);
+    free(key);
+    if (!ok) return NULL;
+    o->valid = 1;
+    return o->pos;
+}
+
+/* readers holding db_lock shared may race to build the same order */
+static const int* sort_order_get(SortKey k) {
+    cms_mutex_lock(&index_lock);
+    const int* pos = sort_order_build(k);
+    cms_mutex_unlock(&index_lock);
+    return pos;
+}
+
+static void sort_orders_invalidate(void) {
+    for (int k=0;k<SORT_KEYS;++k) sort_orders[k].valid = 0;
+}
+
+static int sort_key_equal(SortKey k, int a, int b) {
+    switch (k) {
+    case SORT_PROGRAMME: return col_prog[a] == col_prog[b];
+    case SORT_NAME: return strcmp(rec_name(a), rec_name(b)) == 0;
+    default: return a == b;   /* ID and MARK orders tie-break by ID, so no two slots are equal */
+    }
+}
+
+typedef void (*SlotVisitor)(int slot, void* ctx);
+
+/* Visit `count` slots of order k starting at rank `offset`. DESC walks the
+   order backwards, but equal PROGRAMME/NAME keys keep insertion order. */
+static void sort_order_walk(SortKey k, const int* pos, int desc, int offset, int count,
+                            SlotVisitor visit, void* ctx) {
+    int stop = offset + count;
+    if (!desc) {
+        for (int r=offset; r<stop; ++r) visit(pos[r], ctx);
+        return;
+    }
+    int rank = 0, end = n_records-1;
+    while (end >= 0 && rank < stop) {
+        int start = end;
+        while (start > 0 && sort_key_equal(k, pos[start-1], pos[end])) start--;
+        for (int j=start; j<=end && rank<stop; ++j, ++rank) {
+            if (rank >= offset) visit(pos[j], ctx);
+        }
+        end = start-1;
+    }
+}
+
+
+/* ---- ID index: open-addressing hash (linear probing) from ID to record slot ---- */
+typedef struct {
+    int id;
+    int slot;   /* record slot (column index), -1 = empty bucket */
+} IdSlot;
+
+static IdSlot* id_index = NULL;
+static int id_index_bits = 0;   /* capacity is 1<<bits */
+static int id_index_used = 0;
+
+static size_t id_hash(int id) {
+    /* Fibonacci hashing: consecutive IDs spread over the top bits */
+    return (size_t)(((uint32_t)id * 2654435769u) >> (32 - id_index_bits));
+}
+
+static void id_index_clear(void) {
+    size_t cap = (size_t)1 << id_index_bits;
+    if (id_index) for (size_t i=0;i<cap;++i) id_index[i].slot = -1;
+    id_index_used = 0;
+}
+
+static int id_index_put(int id, int slot);
+
+/* keep the load factor at or below 1/2 */
+static int id_index_reserve(int n) {
+    if (id_index && (size_t)n*2 <= ((size_t)1 << id_index_bits)) return 1;
+    int bits = 4;
+    while (((size_t)1 << bits) < (size_t)n*2) bits++;
+    IdSlot* old = id_index;
+    size_t old_cap = old ? (size_t)1 << id_index_bits : 0;
+    IdSlot* fresh = (IdSlot*)malloc(sizeof(IdSlot) << bits);
+    if (!fresh) return 0;
+    id_index = fresh; id_index_bits = bits;
+    id_index_clear();
+    for (size_t i=0;i<old_cap;++i) if (old[i].slot>=0) id_index_put(old[i].id, old[i].slot);
+    free(old);
+    return 1;
+}
+
+/* insert or overwrite the slot for an ID */
+static int id_index_put(int id, int slot) {
+    if (!id_index_reserve(id_index_used+1)) return 0;
+    size_t mask = ((size_t)1 << id_index_bits) - 1;
+    size_t i = id_hash(id);
+    while (id_index[i].slot >= 0) {
+        if (id_index[i].id == id) { id_index[i].slot = slot; return 1; }
+        i = (i+1) & mask;
+    }
+    id_index[i].id = id; id_index[i].slot = slot;
+    id_index_used++;
+    return 1;
+}
+
+static int id_index_get(int id) {
+    if (!id_index) return -1;
+    size_t mask = ((size_t)1 << id_index_bits) - 1;
+    size_t i = id_hash(id);
+    while (id_index[i].slot >= 0) {
+        if (id_index[i].id == id) return id_index[i].slot;
+        i = (i+1) & mask;
+    }
+    return -1;
+}
+
+/* backward-shift deletion keeps probe chains intact without tombstones */
+static void id_index_remove(int id) {
+    if (!id_index) return;
+    size_t mask = ((size_t)1 << id_index_bits) - 1;
+    size_t i = id_hash(id);
+    while (id_index[i].slot >= 0 && id_index[i].id != id) i = (i+1) & mask;
+    if (id_index[i].slot < 0) return;
+    size_t hole = i;
+    for (size_t j = (i+1) & mask; id_index[j].slot >= 0; j = (j+1) & mask) {
+        size_t home = id_hash(id_index[j].id);
+        /* move j into the hole unless its home lies cyclically in (hole, j] */
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            id_index[hole] = id_index[j];
+            hole = j;
+        }
+    }
+    id_index[hole].slot = -1;
+    id_index_used--;
+}
+
+/* DELETE leaves a tombstone: the slot drops out of the ID and trigram
+   indexes but keeps its values, so the sort orders (which still list it)
+   stay sorted. Commands that walk the slots run store_compact() first. */
+static int* dead_slots = NULL;
+static int n_dead = 0, dead_cap = 0;
+
+static int find_index_by_id(int id) {
+    return id_index_get(id);
+}
+
+/* ---- Running mark aggregates ----
+ * Every store mutation adjusts count, sum, sum of squares and grade bands,
+ * overall and per programme, so the summaries do not rescan the marks.
+ * Sums are integers in fixed point: a record always adds and removes the
+ * same amount, so they never drift. Per programme, removing the record at
+ * the lowest slot, minimum or maximum only flags the programme; the next
+ * summary refreshes flagged programmes in one pass.
+ * Fixed point holds marks within +-AGG_FX_LIM on tables of up to
+ * AGG_FX_ROWS records; past either, the summaries take their sums from a
+ * double-precision scan instead (agg_exact). */
+#define AGG_FX  1073741824.0   /* sum unit 2^-30 */
+#define AGG_FX2 16777216.0     /* sum-of-squares unit 2^-24 */
+#define AGG_FX_LIM 128.0       /* |mark| * 2^30 and mark^2 * 2^24 stay below 2^38 */
+#define AGG_FX_ROWS (1 << 25)  /* so 2^25 of them sum below 2^63 */
+
+typedef struct {
+    int count;
+    int first;         /* lowest slot: programmes are listed in first-seen order */
+    uint64_t sum, sumsq;   /* two's complement: exact while agg_exact() holds */
+    float lo, hi;
+    int stale;         /* first/lo/hi need a refresh */
+} MarkAgg;
+
+static MarkAgg agg_all;            /* first/lo/hi unused: the MARK order gives those */
+static int agg_band[4];            /* marks >= 80, 70, 60, 50 */
+static MarkAgg* agg_prog = NULL;   /* by programme ID */
+static int agg_prog_cap = 0;
+static int agg_valid = 1;          /* 0 after a bulk rewrite or failed allocation: rebuild by a scan */
+static int agg_stale = 0;          /* some programme is flagged */
+static int agg_wide = 0;           /* marks outside +-AGG_FX_LIM (or NaN), left out of the sums */
+
+static MarkAgg* agg_of(uint32_t p) {
+    if ((int)p >= agg_prog_cap) {
+        int cap = agg_prog_cap ? agg_prog_cap : 16;
+        while (cap <= (int)p) cap *= 2;
+        MarkAgg* a = (MarkAgg*)realloc(agg_prog, sizeof(MarkAgg)*(size_t)cap);
+        if (!a) return NULL;
+        memset(a+agg_prog_cap, 0, sizeof(MarkAgg)*(size_t)(cap-agg_prog_cap));
+        agg_prog = a; agg_prog_cap = cap;
+    }
+    return &agg_prog[p];
+}
+
+static int agg_fx_ok(float m)    { return m >= -AGG_FX_LIM && m <= AGG_FX_LIM; }   /* false for NaN */
+static uint64_t agg_fx(float m)  { return agg_fx_ok(m) ? (uint64_t)(int64_t)((double)m * AGG_FX) : 0; }
+static uint64_t agg_fx2(float m) { return agg_fx_ok(m) ? (uint64_t)((double)m * m * AGG_FX2) : 0; }
+
+/* the fixed-point sums are the true ones */
+static int agg_exact(void) { return agg_wide == 0 && n_records <= AGG_FX_ROWS; }
+
+/* adds (sign 1) or removes (sign -1) one mark in a programme's totals and the overall ones */
+static void agg_note(uint32_t p, int slot, float m, int sign) {
+    if (!agg_valid) return;
+    MarkAgg* a = agg_of(p);
+    if (!a) { agg_valid = 0; return; }
+    uint64_t fx = agg_fx(m), fx2 = agg_fx2(m);
+    if (sign < 0) { fx = 0-fx; fx2 = 0-fx2; }
+    agg_wide += sign*!agg_fx_ok(m);
+    agg_all.count += sign; agg_all.sum += fx; agg_all.sumsq += fx2;
+    agg_band[0] += sign*(m >= 80.0f); agg_band[1] += sign*(m >= 70.0f);
+    agg_band[2] += sign*(m >= 60.0f); agg_band[3] += sign*(m >= 50.0f);
+    if (sign > 0 && a->count == 0) {
+        a->first = slot; a->lo = a->hi = m; a->stale = 0;
+    } else if (sign > 0) {
+        if (slot < a->first) a->first = slot;
+        if (m < a->lo) a->lo = m;
+        if (m > a->hi) a->hi = m;
+    } else if (a->count > 1 && (slot == a->first || m == a->lo || m == a->hi)) {
+        a->stale = 1; agg_stale = 1;
+    }
+    a->count += sign; a->sum += fx; a->sumsq += fx2;
+}
+
+static void agg_clear(void) {
+    memset(&agg_all, 0, sizeof(agg_all));
+    memset(agg_band, 0, sizeof(agg_band));
+    if (agg_prog) memset(agg_prog, 0, sizeof(MarkAgg)*(size_t)agg_prog_cap);
+    agg_valid = 1;
+    agg_stale = 0;
+    agg_wide = 0;
+}
+
+/* On large tables the rebuild (or the repair of flagged programmes) runs as
+   pool tasks over slot ranges, each into its own row of per-programme
+   totals; the rows are then added up. The sums are integers (modulo 2^64),
+   so the result does not depend on how the table was split. */
+#define AGG_PAR_MAX (1 << 18)   /* per-task totals allowed in memory */
+
+typedef struct {
+    int rebuild;       /* whole totals, or only first/lo/hi of flagged programmes */
+    int tasks;
+    MarkAgg* part;     /* one row of n_progs per task */
+    int* band;         /* one row of 5 per task: the grade bands, then agg_wide */
+} AggJob;
+
+static void agg_task(void* ctx, int task) {
+    AggJob* j = (AggJob*)ctx;
+    MarkAgg* part = j->part + (size_t)task*n_progs;
+    int* band = j->band + 5*task;
+    int lo = (int)((long long)n_records*task/j->tasks), hi = (int)((long long)n_records*(task+1)/j->tasks);
+    for (int i=lo;i<hi;++i) {
+        uint32_t p = col_prog[i];
+        if (!j->rebuild && !agg_prog[p].stale) continue;
+        MarkAgg* a = &part[p];
+        float m = col_mark[i];
+        if (a->count++ == 0) { a->first = i; a->lo = a->hi = m; }
+        else if (m < a->lo) a->lo = m;
+        else if (m > a->hi) a->hi = m;
+        if (!j->rebuild) continue;
+        a->sum += agg_fx(m); a->sumsq += agg_fx2(m);
+        band[0] += m >= 80.0f; band[1] += m >= 70.0f; band[2] += m >= 60.0f; band[3] += m >= 50.0f;
+        band[4] += !agg_fx_ok(m);
+    }
+}
+
+/* the rebuild or repair as pool tasks; 0 when not worth it or out of memory (callers scan instead) */
+static int agg_scan_parallel(int rebuild) {
+    int tasks = worker_count()*4, most = (n_records + SCAN_CHUNK-1) / SCAN_CHUNK;
+    if (tasks > most) tasks = most;
+    if (worker_count() <= 1 || tasks <= 1 || (long long)tasks*n_progs > AGG_PAR_MAX) return 0;
+    if (n_progs > 0 && !agg_of((uint32_t)n_progs-1)) return 0;
+    AggJob j = { rebuild, tasks, (MarkAgg*)calloc((size_t)tasks*n_progs, sizeof(MarkAgg)),
+                 (int*)calloc((size_t)tasks*5, sizeof(int)) };
+    if (!j.part || !j.band) { free(j.part); free(j.band); return 0; }
+    pool_run(tasks, agg_task, &j);
+    if (rebuild) agg_clear();
+    for (int t=0;t<tasks;++t) {
+        for (int p=0;p<n_progs;++p) {
+            const MarkAgg* a = &j.part[(size_t)t*n_progs + p];
+            MarkAgg* to = &agg_prog[p];
+            if (a->count == 0) continue;
+            if (rebuild && to->count == 0) { to->first = a->first; to->lo = a->lo; to->hi = a->hi; }
+            if (a->first < to->first) to->first = a->first;
+            if (a->lo < to->lo) to->lo = a->lo;
+            if (a->hi > to->hi) to->hi = a->hi;
+            if (!rebuild) continue;
+            to->count += a->count; to->sum += a->sum; to->sumsq += a->sumsq;
+            agg_all.count += a->count; agg_all.sum += a->sum; agg_all.sumsq += a->sumsq;
+        }
+        for (int k=0;k<4;++k) agg_band[k] += j.band[5*t+k];
+        agg_wide += j.band[5*t+4];
+    }
+    free(j.part); free(j.band);
+    return 1;
+}
+
+/* brings the aggregates up to date (call with no tombstones); 0 when out of memory.
+   Readers share the lock, so the repair runs under index_lock like the lazy indexes. */
+static int agg_refresh(void) {
+    cms_mutex_lock(&index_lock);
+    if (!agg_valid) {
+        if (!agg_scan_parallel(1)) {
+            agg_clear();
+            for (int i=0;i<n_records && agg_valid;++i) agg_note(col_prog[i], i, col_mark[i], 1);
+        }
+    } else if (agg_stale) {
+        for (int p=0;p<agg_prog_cap;++p) {
+            if (!agg_prog[p].stale) continue;
+            agg_prog[p].first = INT_MAX; agg_prog[p].lo = FLT_MAX; agg_prog[p].hi = -FLT_MAX;
+        }
+        if (!agg_scan_parallel(0)) {
+            for (int i=0;i<n_records;++i) {
+                MarkAgg* a = &agg_prog[col_prog[i]];
+                if (!a->stale) continue;
+                if (i < a->first) a->first = i;
+                if (col_mark[i] < a->lo) a->lo = col_mark[i];
+                if (col_mark[i] > a->hi) a->hi = col_mark[i];
+            }
+        }
+        for (int p=0;p<agg_prog_cap;++p) agg_prog[p].stale = 0;
+        agg_stale = 0;
+    }
+    int ok = agg_valid;
+    cms_mutex_unlock(&index_lock);
+    return ok;
+}
+
+/* overwrite the fields of slot i (the ID index is the caller's concern); 0 when out of memory */
+static int store_set(int i, const Student* s) {
+    store_epoch++;
+    int p = prog_intern(s->programme);
+    if (p < 0) return 0;
+    int name_changed = strcmp(rec_name(i), s->name) != 0;
+    uint32_t off = col_name[i];
+    if (name_changed && !name_append(s->name, &off)) return 0;
+
+    /* orders whose key changes are re-positioned around the write */
+    int moved[SORT_KEYS] = {0};
+    moved[SORT_ID] = col_id[i] != s->id;
+    moved[SORT_MARK] = moved[SORT_ID] || col_mark[i] != s->mark;
+    moved[SORT_PROGRAMME] = col_prog[i] != (uint32_t)p;
+    moved[SORT_NAME] = name_changed;
+    for (int k=0;k<SORT_KEYS;++k) if (moved[k] && sort_orders[k].valid) sort_order_remove((SortKey)k, i);
+    int retri = name_tri.valid && (moved[SORT_ID] || name_changed);
+    if (retri) tri_remove(&name_tri, rec_name(i), col_id[i]);
+
+    int reagg = col_mark[i] != s->mark || moved[SORT_PROGRAMME];
+    if (reagg) agg_note(col_prog[i], i, col_mark[i], -1);
+    if (name_changed) {
+        name_garbage += strlen(rec_name(i))+1;
+        col_name[i] = off;
+    }
+    col_id[i] = s->id;
+    col_prog[i] = (uint32_t)p;
+    col_mark[i] = s->mark;
+    if (reagg) agg_note(col_prog[i], i, col_mark[i], 1);
+    for (int k=0;k<SORT_KEYS;++k) if (moved[k] && sort_orders[k].valid) sort_order_insert((SortKey)k, i, n_records-1);
+    if (retri && !tri_add(&name_tri, s->name, s->id)) tri_clear(&name_tri);
+    name_maybe_compact();
+    return 1;
+}
+
+/* drop every record and interned string (OPEN starts from scratch) */
+static void store_clear(void) {
+    store_epoch++;
+    n_records = 0;
+    n_dead = 0;
+    sort_orders_invalidate();
+    tri_clear(&name_tri);
+    id_index_clear();
+    name_used = 0;
+    name_garbage = 0;
+    prog_dict_clear();
+    agg_clear();
+}
+
+/* append a record at the end of the store; returns its slot or -1. On failure
+   a newly interned programme stays in the dictionary with no records (listings
+   skip those) and the name already copied is counted as garbage. */
+static int store_append(const Student* s) {
+    store_epoch++;
+    if (!records_reserve(n_records+1)) return -1;
+    int p = prog_intern(s->programme);
+    uint32_t off;
+    if (p < 0 || !name_append(s->name, &off)) return -1;
+    if (!id_index_put(s->id, n_records)) {
+        name_garbage += strlen(s->name)+1;
+        return -1;
+    }
+    col_id[n_records] = s->id;
+    col_mark[n_records] = s->mark;
+    col_name[n_records] = off;
+    col_prog[n_records] = (uint32_t)p;
+    agg_note((uint32_t)p, n_records, s->mark, 1);
+    for (int k=0;k<SORT_KEYS;++k) if (sort_orders[k].valid) sort_order_insert((SortKey)k, n_records, n_records);
+    if (name_tri.valid && !tri_add(&name_tri, s->name, s->id)) tri_clear(&name_tri);
+    return n_records++;
+}
+
+/* drops every tombstone in one pass, keeping the display order of the rest */
+static void store_compact(void) {
+    if (!n_dead) return;
+    qsort(dead_slots, (size_t)n_dead, sizeof(int), cmp_int_asc);
+    int w = 0, d = 0;
+    for (int i=0;i<n_records;++i) {
+        if (d < n_dead && dead_slots[d] == i) {
+            name_garbage += strlen(rec_name(i))+1;
+            d++;
+            continue;
+        }
+        col_id[w] = col_id[i]; col_mark[w] = col_mark[i];
+        col_name[w] = col_name[i]; col_prog[w] = col_prog[i];
+        w++;
+    }
+    /* slots shift down by the number of tombstones before them; orders stay sorted */
+    for (int k=0;k<SORT_KEYS;++k) {
+        if (!sort_orders[k].valid) continue;
+        int* pos = sort_orders[k].pos, m = 0;
+        for (int r=0;r<n_records;++r) {
+            int lo = 0, hi = n_dead;
+            while (lo < hi) { int mid = lo + (hi-lo)/2; if (dead_slots[mid] < pos[r]) lo = mid+1; else hi = mid; }
+            if (lo < n_dead && dead_slots[lo] == pos[r]) continue;
+            pos[m++] = pos[r] - lo;
+        }
+    }
+    for (int p=0;p<agg_prog_cap;++p) {   /* the first slots shift the same way */
+        MarkAgg* a = &agg_prog[p];
+        if (!a->count || a->stale) continue;
+        int lo = 0, hi = n_dead;
+        while (lo < hi) { int mid = lo + (hi-lo)/2; if (dead_slots[mid] < a->first) lo = mid+1; else hi = mid; }
+        a->first -= lo;
+    }
+    n_records = w;
+    n_dead = 0;
+    id_index_clear();
+    for (int i=0;i<n_records;++i) id_index_put(col_id[i], i);
+    name_maybe_compact();
+}
+
+/* tombstone the record at idx (see dead_slots) */
+static void store_remove_at(int idx) {
+    store_epoch++;
+    int id = col_id[idx];
+    if (n_dead == dead_cap) {
+        int cap = dead_cap ? dead_cap*2 : 64;
+        int* d = (int*)realloc(dead_slots, sizeof(int)*(size_t)cap);
+        if (d) { dead_slots = d; dead_cap = cap; }
+        else store_compact();   /* reuse the list we have */
+    }
+    if (n_dead == dead_cap) {   /* not even one entry: nothing to do but fall back to a full rebuild */
+        dead_slots = &idx; n_dead = 1;
+        if (name_tri.valid) tri_remove(&name_tri, rec_name(idx), id);
+        agg_note(col_prog[idx], idx, col_mark[idx], -1);
+        store_compact();
+        dead_slots = NULL;
+        return;
+    }
+    if (name_tri.valid) tri_remove(&name_tri, rec_name(idx), id);
+    id_index_remove(id);
+    agg_note(col_prog[idx], idx, col_mark[idx], -1);
+    dead_slots[n_dead++] = idx;
+}
+
+/* remove every record whose ID is listed, in one compaction pass; returns how many went */
+static int store_remove_ids(const int* ids, int n) {
+    store_compact();
+    store_epoch++;
+    unsigned char* dead = (unsigned char*)calloc((size_t)(n_records ? n_records : 1), 1);
+    int removed = 0;
+    if (!dead) {
+        for (int j=0;j<n;++j) {
+            int idx = find_index_by_id(ids[j]);
+            if (idx >= 0) { store_remove_at(idx); removed++; }
+        }
+        return removed;
+    }
+    for (int j=0;j<n;++j) {
+        int idx = find_index_by_id(ids[j]);
+        if (idx < 0 || dead[idx]) continue;
+        dead[idx] = 1;
+        name_garbage += strlen(rec_name(idx))+1;
+        removed++;
+    }
+    int w = 0;
+    for (int i=0;i<n_records;++i) {
+        if (dead[i]) continue;
+        col_id[w] = col_id[i]; col_mark[w] = col_mark[i];
+        col_name[w] = col_name[i]; col_prog[w] = col_prog[i];
+        w++;
+    }
+    n_records = w;
+    free(dead);
+    /* slots moved wholesale: rebuild the ID index, let the other indexes rebuild lazily */
+    id_index_clear();
+    for (int i=0;i<n_records;++i) id_index_put(col_id[i], i);
+    sort_orders_invalidate();
+    tri_clear(&name_tri);
+    agg_valid = 0;
+    name_maybe_compact();
+    return removed;
+}
+
+/* reentrant strtok(…, "|"): skips empty fields the same way */
+static char* next_field(char** cursor) {
+    char* p = *cursor;
+    while (*p == '|') p++;
+    if (!*p) { *cursor = p; return NULL; }
+    char* start = p;
+    while (*p && *p != '|') p++;
+    if (*p) *p++ = '\0';
+    *cursor = p;
+    return start;
+}
+
+/* parse one "ID|Name|Programme|Mark" row (modified in place); safe to call from worker threads */
+static int parse_db_line(char* line, Student* s) {
+    char* cur = line;
+    char* p1 = next_field(&cur);
+    char* p2 = next_field(&cur);
+    char* p3 = next_field(&cur);
+    char* p4 = next_field(&cur);
+    if (!p1||!p2||!p3||!p4) return 0;
+    s->id=atoi(p1);
+    strncpy(s->name,p2,MAX_NAME-1); s->name[MAX_NAME-1]=0;
+    strncpy(s->programme,p3,MAX_PROG-1); s->programme[MAX_PROG-1]=0;
+    s->mark=(float)atof(p4);
+    return 1;
+}
+
+static long snapshot_bytes = 0;   /* size of the last loaded/saved database file */
+
+/* ---- Store snapshots ----
+ * SAVE writes from a StoreSnap: a private copy of the columns taken under
+ * the exclusive lock, so a background thread can format it while commands
+ * carry on, or (when memory is short) a view of the live store. */
+typedef struct {
+    int n;
+    const int* id;
+    const float* mark;
+    const uint32_t* name;      /* offsets into names */
+    const uint32_t* prog;      /* indexes into progs */
+    const char* names;
+    char** progs;
+    int n_progs;
+    void* owned;               /* the single block behind a copy; NULL for a live view */
+} StoreSnap;
+
+static const char* snap_name(const StoreSnap* s, int i) { return s->names + s->name[i]; }
+static const char* snap_prog(const StoreSnap* s, int i) { return s->progs[s->prog[i]]; }
+
+static void snap_live(StoreSnap* s) {
+    s->n = n_records;
+    s->id = col_id; s->mark = col_mark; s->name = col_name; s->prog = col_prog;
+    s->names = name_arena; s->progs = prog_str; s->n_progs = n_progs;
+    s->owned = NULL;
+}
+
+/* copies the columns, the name arena and the programme strings into one block */
+static int snap_copy(StoreSnap* s) {
+    size_t n = (size_t)n_records, prog_bytes = 0;
+    for (int p=0;p<n_progs;++p) prog_bytes += strlen(prog_str[p])+1;
+    size_t ptrs = sizeof(char*)*(size_t)n_progs, cols = n*(sizeof(int)+sizeof(float)+2*sizeof(uint32_t));
+    char* block = (char*)malloc(ptrs + cols + name_used + prog_bytes + 1);
+    if (!block) return 0;
+    char** progs = (char**)block;
+    int* id = (int*)(block + ptrs);
+    float* mark = (float*)(id + n);
+    uint32_t* name = (uint32_t*)(mark + n);
+    uint32_t* prog = name + n;
+    char* names = (char*)(prog + n);
+    char* text = names + name_used;
+    memcpy(id, col_id, n*sizeof(int));
+    memcpy(mark, col_mark, n*sizeof(float));
+    memcpy(name, col_name, n*sizeof(uint32_t));
+    memcpy(prog, col_prog, n*sizeof(uint32_t));
+    if (name_used) memcpy(names, name_arena, name_used);
+    for (int p=0;p<n_progs;++p) {
+        size_t len = strlen(prog_str[p])+1;
+        memcpy(text, prog_str[p], len);
+        progs[p] = text;
+        text += len;
+    }
+    s->n = n_records;
+    s->id = id; s->mark = mark; s->name = name; s->prog = prog;
+    s->names = names; s->progs = progs; s->n_progs = n_progs;
+    s->owned = block;
+    return 1;
+}
+
+static void snap_free(StoreSnap* s) {
+    free(s->owned);
+    s->owned = NULL;
+}
+
+/* ---- Binary snapshot format ----
+ * 32-byte header followed by fixed-size records, so OPEN validates the
+ * checksum and scatters the record area straight into the columns
+ * instead of parsing every field. Selected with SET FORMAT BINARY; OPEN
+ * detects either format from the first bytes of the file. */
+#define BIN_MAGIC "CMSB"
+#define BIN_VERSION 1
+#define BIN_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t record_size;
+    uint32_t count;
+    uint32_t byte_order;
+    uint32_t reserved;
+    uint64_t checksum;      /* over the record area */
+} BinHeader;
+
+typedef struct {
+    int32_t id;
+    char name[MAX_NAME];
+    char programme[MAX_PROG];
+    float mark;
+} BinRecord;
+
+#define CHECKSUM_SEED 1469598103934665603ULL
+
+/* FNV-style hash folded a 64-bit word at a time; callers feed multiples of 8 bytes until the tail */
+static uint64_t checksum_update(uint64_t h, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    while (len >= 8) {
+        uint64_t w; memcpy(&w, p, 8);
+        h = (h ^ w) * 1099511628211ULL;
+        h ^= h >> 29;
+        p += 8; len -= 8;
+    }
+    while (len--) h = (h ^ *p++) * 1099511628211ULL;
+    return h;
+}
+
+/* read-only view of a whole file: mmap where available, one fread otherwise */
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    int mapped;
+} FileView;
+
+static int file_view_open(const char* filename, FileView* v) {
+    v->data = NULL; v->size = 0; v->mapped = 0;
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return 0; }
+    v->size = (size_t)st.st_size;
+    if (v->size > 0) {
+        void* p = mmap(NULL, v->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) { v->data = (const unsigned char*)p; v->mapped = 1; }
+    }
+    close(fd);
+    if (v->mapped || v->size == 0) return 1;
+#endif
+    FILE* f = fopen(filename, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long sz = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (sz < 0) { fclose(f); return 0; }
+    v->size = (size_t)sz;
+    unsigned char* buf = (unsigned char*)malloc(v->size ? v->size : 1);
+    if (!buf || fread(buf, 1, v->size, f) != v->size) { free(buf); fclose(f); return 0; }
+    fclose(f);
+    v->data = buf;
+    return 1;
+}
+
+static void file_view_close(FileView* v) {
+#ifndef _WIN32
+    if (v->mapped) { munmap((void*)v->data, v->size); v->data = NULL; return; }
+#endif
+    free((void*)v->data);
+    v->data = NULL;
+}
+
+/* returns 1 on success, -1 if the file is not a valid snapshot */
+static int load_db_binary(const char* filename) {
+    FileView v;
+    if (!file_view_open(filename, &v)) return 0;
+    BinHeader h;
+    int ok = v.size >= sizeof(h);
+    if (ok) memcpy(&h, v.data, sizeof(h));
+    ok = ok && memcmp(h.magic, BIN_MAGIC, 4) == 0 && h.version == BIN_VERSION &&
+         h.header_size == sizeof(BinHeader) && h.record_size == sizeof(BinRecord) &&
+         h.byte_order == BIN_BYTE_ORDER &&
+         h.count <= (uint32_t)INT_MAX &&
+         v.size == sizeof(BinHeader) + (size_t)h.count * sizeof(BinRecord);
+    const unsigned char* area = v.data + sizeof(BinHeader);
+    ok = ok && checksum_update(CHECKSUM_SEED, area, (size_t)h.count * sizeof(BinRecord)) == h.checksum;
+    ok = ok && records_reserve((int)h.count);
+    if (!ok) { file_view_close(&v); return -1; }
+
+    int n = (int)h.count;
+    store_clear();
+    id_index_reserve(n);
+    for (int i=0;i<n;++i) {
+        BinRecord r;
+        memcpy(&r, area + (size_t)i*sizeof(BinRecord), sizeof(r));
+        Student s;
+        s.id = r.id;
+        s.mark = r.mark;
+        memcpy(s.name, r.name, MAX_NAME);
+        memcpy(s.programme, r.programme, MAX_PROG);
+        s.name[MAX_NAME-1] = 0;
+        s.programme[MAX_PROG-1] = 0;
+        if (id_index_get(s.id) >= 0) {
+            out_printf("CMS: Warning: duplicate ID=%d in record %d, skipped.\n", s.id, i+1);
+            continue;
+        }
+        if (store_append(&s) < 0) {
+            out_printf("CMS: Warning: out of memory at record %d, remaining records not loaded.\n", i+1);
+            break;
+        }
+    }
+    file_view_close(&v);
+    snapshot_bytes = (long)v.size;
+    return 1;
+}
+
+static int save_db_binary(const StoreSnap* s, const char* filename, long* bytes) {
+    FILE* f = fopen(filename, "wb");
+    if (!f) return 0;
+    BinHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BIN_MAGIC, 4);
+    h.version = BIN_VERSION;
+    h.header_size = sizeof(BinHeader);
+    h.record_size = sizeof(BinRecord);
+    h.count = (uint32_t)s->n;
+    h.byte_order = BIN_BYTE_ORDER;
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1;
+
+    /* sizeof(BinRecord) is a multiple of 8, so chunked checksumming matches a one-shot pass */
+    enum { CHUNK = 1024 };
+    BinRecord* buf = (BinRecord*)calloc(CHUNK, sizeof(BinRecord));
+    uint64_t sum = CHECKSUM_SEED;
+    ok = ok && buf;
+    for (int i=0; ok && i<s->n; i+=CHUNK) {
+        int m = s->n-i < CHUNK ? s->n-i : CHUNK;
+        memset(buf, 0, (size_t)m*sizeof(BinRecord));
+        for (int k=0;k<m;++k) {
+            buf[k].id = s->id[i+k];
+            strncpy(buf[k].name, snap_name(s, i+k), MAX_NAME-1);
+            strncpy(buf[k].programme, snap_prog(s, i+k), MAX_PROG-1);
+            buf[k].mark = s->mark[i+k];
+        }
+        sum = checksum_update(sum, buf, (size_t)m*sizeof(BinRecord));
+        ok = fwrite(buf, sizeof(BinRecord), (size_t)m, f) == (size_t)m;
+    }
+    free(buf);
+    h.checksum = sum;
+    ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, f) == 1;
+    if (ok) ok = fflush(f) == 0 && fsync_file(f) == 0;
+    if (fclose(f) != 0) ok = 0;
+    if (ok) *bytes = (long)(sizeof(BinHeader) + (size_t)s->n*sizeof(BinRecord));
+    return ok;
+}
+
+/* ---- Compact file format ----
+ * Column-wise, for files a fraction of the text size. After a 40-byte
+ * header the payload holds, with records in ID order:
+ *   the programme dictionary (varint length and bytes per programme),
+ *   IDs as a zigzag varint followed by varint gaps,
+ *   each record's programme number (varint),
+ *   marks as 16-bit hundredths (float32 when any mark needs more digits),
+ *   name lengths (varint) followed by all the name bytes,
+ *   and, unless the store already is in ID order, each record's slot
+ *   (varint), so OPEN restores the listing order.
+ * Fixed-width payload fields are little-endian. SET FORMAT COMPACT LZ cuts
+ * the payload into 1 MB blocks, each compressed by a small LZ77 coder as a
+ * pool task; the checksum always covers the uncompressed payload. */
+#define CMPT_MAGIC "CMSC"
+#define CMPT_VERSION 1
+#define CMPT_SLOTS 1u           /* flags: slot section present */
+#define CMPT_FLOAT_MARKS 2u     /* marks are float32, not hundredths */
+#define CMPT_LZ 4u              /* payload is stored as LZ blocks */
+#define CMPT_BLOCK ((size_t)1 << 20)
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t count;
+    uint32_t n_progs;
+    uint32_t flags;
+    uint32_t byte_order;
+    uint64_t raw_size;      /* payload bytes before compression */
+    uint64_t checksum;      /* over the uncompressed payload */
+} CompactHeader;
+
+typedef struct {
+    unsigned char* p;
+    size_t n, cap;
+    int failed;
+} ByteBuf;
+
+static unsigned char* bb_room(ByteBuf* b, size_t need) {
+    if (b->failed) return NULL;
+    if (need > b->cap - b->n) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap - b->n < need) cap *= 2;
+        unsigned char* q = (unsigned char*)realloc(b->p, cap);
+        if (!q) { b->failed = 1; return NULL; }
+        b->p = q; b->cap = cap;
+    }
+    return b->p + b->n;
+}
+
+static void bb_varint(ByteBuf* b, uint64_t v) {
+    unsigned char* q = bb_room(b, 10);
+    if (!q) return;
+    size_t k = 0;
+    while (v >= 0x80) { q[k++] = (unsigned char)(v | 0x80); v >>= 7; }
+    q[k++] = (unsigned char)v;
+    b->n += k;
+}
+
+static void bb_bytes(ByteBuf* b, const void* src, size_t len) {
+    unsigned char* q = bb_room(b, len);
+    if (q && len) { memcpy(q, src, len); b->n += len; }
+}
+
+typedef struct {
+    const unsigned char* p;
+    const unsigned char* end;
+    int bad;
+} ByteReader;
+
+static uint64_t br_varint(ByteReader* r) {
+    uint64_t v = 0;
+    for (int shift=0; shift<64 && r->p<r->end; shift+=7) {
+        unsigned char c = *r->p++;
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return v;
+    }
+    r->bad = 1;
+    return 0;
+}
+
+static const unsigned char* br_bytes(ByteReader* r, size_t len) {
+    if ((size_t)(r->end - r->p) < len) { r->bad = 1; return NULL; }
+    const unsigned char* q = r->p;
+    r->p += len;
+    return q;
+}
+
+static void put_le32(unsigned char* q, uint32_t v) {
+    q[0] = (unsigned char)v; q[1] = (unsigned char)(v >> 8);
+    q[2] = (unsigned char)(v >> 16); q[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t get_le32(const unsigned char* q) {
+    return (uint32_t)q[0] | (uint32_t)q[1] << 8 | (uint32_t)q[2] << 16 | (uint32_t)q[3] << 24;
+}
+
+static float mark_from_hundredths(unsigned h) { return (float)((double)h / 100.0); }
+
+/* the mark in hundredths, rounded as fmt_mark does; 0 unless they give back exactly m */
+static int mark_hundredths(float m, unsigned* h) {
+    double v = (double)m * 100.0;
+    if (!(v >= 0.0 && v < 65535.5)) return 0;
+    unsigned r = (unsigned)v;
+    double frac = v - (double)r;
+    if (frac > 0.5 || (frac == 0.5 && (r & 1))) r++;
+    float back = mark_from_hundredths(r);
+    if (r > 65535 || memcmp(&back, &m, sizeof(m)) != 0) return 0;
+    *h = r;
+    return 1;
+}
+
+/* ---- LZ block coder ----
+ * LZ4-style sequences: a token (literal count, match length - 4), extra
+ * length bytes when a field is 15, the literals, then a 16-bit offset and
+ * extra match length bytes. The last sequence of a block has literals only. */
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+
+static size_t lz_bound(size_t n) { return n + n/255 + 16; }
+
+static uint32_t lz_read32(const unsigned char* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+static unsigned char* lz_put_length(unsigned char* q, size_t len) {
+    while (len >= 255) { *q++ = 255; len -= 255; }
+    *q++ = (unsigned char)len;
+    return q;
+}
+
+/* literals lit[0..n_lit) then, when off > 0, a match of mlen bytes off back */
+static unsigned char* lz_sequence(unsigned char* q, const unsigned char* lit, size_t n_lit, size_t off, size_t mlen) {
+    unsigned char* token = q++;
+    *token = (unsigned char)((n_lit < 15 ? n_lit : 15) << 4);
+    if (n_lit >= 15) q = lz_put_length(q, n_lit - 15);
+    if (n_lit) memcpy(q, lit, n_lit);
+    q += n_lit;
+    if (off) {
+        size_t m = mlen - LZ_MIN_MATCH;
+        *token |= (unsigned char)(m < 15 ? m : 15);
+        *q++ = (unsigned char)off; *q++ = (unsigned char)(off >> 8);
+        if (m >= 15) q = lz_put_length(q, m - 15);
+    }
+    return q;
+}
+
+/* compresses src[0..n) into dst (lz_bound(n) bytes); returns the compressed size */
+static size_t lz_compress(const unsigned char* src, size_t n, unsigned char* dst) {
+    uint32_t table[1u << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+    unsigned char* q = dst;
+    size_t anchor = 0, i = 0;
+    while (i + LZ_MIN_MATCH <= n) {
+        uint32_t seq = lz_read32(src + i);
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t cand = table[h];
+        table[h] = (uint32_t)i;
+        if (cand < i && i - cand <= 65535 && lz_read32(src + cand) == seq) {
+            size_t len = LZ_MIN_MATCH;
+            while (i + len < n && src[cand + len] == src[i + len]) len++;
+            q = lz_sequence(q, src + anchor, i - anchor, i - cand, len);
+            i += len;
+            anchor = i;
+        } else {
+            i += 1 + ((i - anchor) >> 6);   /* skip faster through data that does not compress */
+        }
+    }
+    return (size_t)(lz_sequence(q, src + anchor, n - anchor, 0, 0) - dst);
+}
+
+static int lz_get_length(const unsigned char** ip, const unsigned char* end, size_t* len) {
+    unsigned char c;
+    do {
+        if (*ip >= end) return 0;
+        c = *(*ip)++;
+        *len += c;
+    } while (c == 255);
+    return 1;
+}
+
+/* 1 when src[0..len) decodes to exactly n bytes; every read and write is bounds-checked */
+static int lz_decompress(const unsigned char* src, size_t len, unsigned char* dst, size_t n) {
+    const unsigned char* ip = src;
+    const unsigned char* end = src + len;
+    size_t op = 0;
+    while (ip < end) {
+        unsigned token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && !lz_get_length(&ip, end, &lit)) return 0;
+        if ((size_t)(end - ip) < lit || n - op < lit) return 0;
+        memcpy(dst + op, ip, lit);
+        ip += lit; op += lit;
+        if (ip == end) break;
+        if (end - ip < 2) return 0;
+        size_t off = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t mlen = token & 15;
+        if (mlen == 15 && !lz_get_length(&ip, end, &mlen)) return 0;
+        mlen += LZ_MIN_MATCH;
+        if (off == 0 || off > op || n - op < mlen) return 0;
+        if (off >= mlen) memcpy(dst + op, dst + op - off, mlen);
+        else for (size_t k=0;k<mlen;++k) dst[op+k] = dst[op+k-off];
+        op += mlen;
+    }
+    return op == n;
+}
+
+/* one block each way: raw[0..raw_len) <-> packed[0..packed_len) */
+typedef struct {
+    unsigned char* raw;
+    size_t raw_len;
+    unsigned char* packed;
+    size_t packed_len;
+    int ok;
+} LzBlock;
+
+static void lz_pack_task(void* ctx, int task) {
+    LzBlock* b = (LzBlock*)ctx + task;
+    b->packed = (unsigned char*)malloc(lz_bound(b->raw_len));
+    b->ok = b->packed != NULL;
+    if (b->ok) b->packed_len = lz_compress(b->raw, b->raw_len, b->packed);
+}
+
+static void lz_unpack_task(void* ctx, int task) {
+    LzBlock* b = (LzBlock*)ctx + task;
+    if (b->packed_len == b->raw_len) { memcpy(b->raw, b->packed, b->raw_len); b->ok = 1; }   /* stored */
+    else b->ok = lz_decompress(b->packed, b->packed_len, b->raw, b->raw_len);
+}
+
+/* writes the payload as blocks of (u32 raw length, u32 packed length, bytes);
+   a block that does not shrink is stored as is */
+static int lz_write_blocks(FILE* f, unsigned char* raw, size_t size, size_t* written) {
+    int n = (int)((size + CMPT_BLOCK - 1) / CMPT_BLOCK);
+    LzBlock* blk = (LzBlock*)calloc((size_t)(n ? n : 1), sizeof(LzBlock));
+    if (!blk) return 0;
+    for (int k=0;k<n;++k) {
+        blk[k].raw = raw + (size_t)k*CMPT_BLOCK;
+        blk[k].raw_len = size - (size_t)k*CMPT_BLOCK < CMPT_BLOCK ? size - (size_t)k*CMPT_BLOCK : CMPT_BLOCK;
+    }
+    pool_run(n, lz_pack_task, blk);
+    int ok = 1;
+    *written = 0;
+    for (int k=0;k<n;++k) {
+        ok = ok && blk[k].ok;
+        if (!ok) break;
+        const unsigned char* data = blk[k].packed;
+        if (blk[k].packed_len >= blk[k].raw_len) { data = blk[k].raw; blk[k].packed_len = blk[k].raw_len; }
+        unsigned char len[8];
+        put_le32(len, (uint32_t)blk[k].raw_len);
+        put_le32(len + 4, (uint32_t)blk[k].packed_len);
+        ok = fwrite(len, 1, 8, f) == 8 && fwrite(data, 1, blk[k].packed_len, f) == blk[k].packed_len;
+        *written += 8 + blk[k].packed_len;
+    }
+    for (int k=0;k<n;++k) free(blk[k].packed);
+    free(blk);
+    return ok;
+}
+
+/* the raw payload behind LZ blocks in src[0..len), or NULL when they are damaged */
+static unsigned char* lz_read_blocks(const unsigned char* src, size_t len, uint64_t raw_size) {
+    uint64_t n = (raw_size + CMPT_BLOCK - 1) / CMPT_BLOCK;
+    if (n > len / 8) return NULL;
+    LzBlock* blk = (LzBlock*)calloc((size_t)(n ? n : 1), sizeof(LzBlock));
+    unsigned char* raw = (unsigned char*)malloc((size_t)(raw_size ? raw_size : 1));
+    int ok = blk && raw;
+    size_t at = 0;
+    for (size_t k=0; ok && k<n; ++k) {
+        size_t want = raw_size - (uint64_t)k*CMPT_BLOCK < CMPT_BLOCK ? (size_t)(raw_size - (uint64_t)k*CMPT_BLOCK) : CMPT_BLOCK;
+        ok = len - at >= 8 && get_le32(src + at) == want;
+        if (!ok) break;
+        blk[k].packed_len = get_le32(src + at + 4);
+        at += 8;
+        ok = blk[k].packed_len <= want && len - at >= blk[k].packed_len;
+        blk[k].packed = (unsigned char*)(src + at);
+        blk[k].raw = raw + k*CMPT_BLOCK;
+        blk[k].raw_len = want;
+        at += blk[k].packed_len;
+    }
+    ok = ok && at == len;
+    if (ok) pool_run((int)n, lz_unpack_task, blk);
+    for (size_t k=0; ok && k<n; ++k) ok = blk[k].ok;
+    free(blk);
+    if (!ok) { free(raw); return NULL; }
+    return raw;
+}
+
+static int save_db_compact(const StoreSnap* s, int lz, const char* filename, long* bytes) {
+    int n = s->n;
+    int* order = (int*)malloc(sizeof(int)*(size_t)(n ? n : 1));
+    uint32_t* key = (uint32_t*)malloc(sizeof(uint32_t)*(size_t)(n ? n : 1));
+    int ok = order && key;
+    for (int i=0; ok && i<n; ++i) { order[i] = i; key[i] = (uint32_t)s->id[i] ^ 0x80000000u; }
+    ok = ok && radix_sort(key, order, n);
+    free(key);
+    if (!ok) { free(order); return 0; }
+
+    CompactHeader h;
+    memset(&h, 0, sizeof(h));
+    for (int i=0;i<n;++i) if (order[i] != i) { h.flags |= CMPT_SLOTS; break; }
+    unsigned hm;
+    for (int i=0;i<n;++i) if (!mark_hundredths(s->mark[i], &hm)) { h.flags |= CMPT_FLOAT_MARKS; break; }
+
+    ByteBuf b = {NULL, 0, 0, 0};
+    for (int p=0;p<s->n_progs;++p) {
+        size_t len = strlen(s->progs[p]);
+        bb_varint(&b, len);
+        bb_bytes(&b, s->progs[p], len);
+    }
+    for (int k=0;k<n;++k) {
+        int64_t id = s->id[order[k]];
+        if (k == 0) bb_varint(&b, id < 0 ? ((uint64_t)(-(id+1)) << 1) | 1 : (uint64_t)id << 1);
+        else bb_varint(&b, (uint64_t)(id - s->id[order[k-1]]));
+    }
+    for (int k=0;k<n;++k) bb_varint(&b, s->prog[order[k]]);
+    unsigned char* q = bb_room(&b, (size_t)n * ((h.flags & CMPT_FLOAT_MARKS) ? 4 : 2));
+    if (q) {
+        for (int k=0;k<n;++k) {
+            float m = s->mark[order[k]];
+            if (h.flags & CMPT_FLOAT_MARKS) {
+                uint32_t bits; memcpy(&bits, &m, 4);
+                put_le32(q, bits); q += 4;
+            } else {
+                mark_hundredths(m, &hm);
+                *q++ = (unsigned char)hm; *q++ = (unsigned char)(hm >> 8);
+            }
+        }
+        b.n = (size_t)(q - b.p);
+    }
+    for (int k=0;k<n;++k) bb_varint(&b, strlen(snap_name(s, order[k])));
+    for (int k=0;k<n;++k) { const char* nm = snap_name(s, order[k]); bb_bytes(&b, nm, strlen(nm)); }
+    if (h.flags & CMPT_SLOTS) for (int k=0;k<n;++k) bb_varint(&b, (uint64_t)order[k]);
+    free(order);
+    if (b.failed) { free(b.p); return 0; }
+
+    memcpy(h.magic, CMPT_MAGIC, 4);
+    h.version = CMPT_VERSION;
+    h.header_size = sizeof(CompactHeader);
+    h.count = (uint32_t)n;
+    h.n_progs = (uint32_t)s->n_progs;
+    h.byte_order = BIN_BYTE_ORDER;
+    h.raw_size = b.n;
+    h.checksum = checksum_update(CHECKSUM_SEED, b.p, b.n);
+    if (lz) h.flags |= CMPT_LZ;
+
+    FILE* f = fopen(filename, "wb");
+    if (!f) { free(b.p); return 0; }
+    size_t body = b.n;
+    ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    if (ok && lz) ok = lz_write_blocks(f, b.p, b.n, &body);
+    else if (ok) ok = fwrite(b.p, 1, b.n, f) == b.n;
+    free(b.p);
+    if (ok) ok = fflush(f) == 0 && fsync_file(f) == 0;
+    if (fclose(f) != 0) ok = 0;
+    if (ok) *bytes = (long)(sizeof(CompactHeader) + body);
+    return ok;
+}
+
+/* returns 1 on success, -1 if the file is not a valid compact database; *lz tells if it was compressed */
+static int load_db_compact(const char* filename, int* lz) {
+    FileView v;
+    if (!file_view_open(filename, &v)) return 0;
+    CompactHeader h;
+    memset(&h, 0, sizeof(h));
+    int ok = v.size >= sizeof(h);
+    if (ok) memcpy(&h, v.data, sizeof(h));
+    ok = ok && memcmp(h.magic, CMPT_MAGIC, 4) == 0 && h.version == CMPT_VERSION &&
+         h.header_size == sizeof(CompactHeader) && h.byte_order == BIN_BYTE_ORDER &&
+         h.count <= (uint32_t)INT_MAX && (h.flags & ~(CMPT_SLOTS|CMPT_FLOAT_MARKS|CMPT_LZ)) == 0 &&
+         h.raw_size <= (uint64_t)SIZE_MAX / 2;
+    const unsigned char* body = v.data + sizeof(CompactHeader);
+    size_t body_len = ok ? v.size - sizeof(CompactHeader) : 0;
+    unsigned char* raw = NULL;
+    *lz = ok && (h.flags & CMPT_LZ);
+    if (*lz) ok = (raw = lz_read_blocks(body, body_len, h.raw_size)) != NULL;
+    else ok = ok && body_len == h.raw_size;
+    const unsigned char* payload = raw ? raw : body;
+    ok = ok && checksum_update(CHECKSUM_SEED, payload, (size_t)h.raw_size) == h.checksum;
+    /* every programme and record takes at least one payload byte */
+    ok = ok && h.n_progs <= h.raw_size && h.count <= h.raw_size;
+    if (!ok) { free(raw); file_view_close(&v); return -1; }
+
+    int n = (int)h.count, np = (int)h.n_progs;
+    const unsigned char** prog_at = (const unsigned char**)malloc(sizeof(char*)*(size_t)(np ? np : 1));
+    size_t* prog_len = (size_t*)malloc(sizeof(size_t)*(size_t)(np ? np : 1));
+    int* id = (int*)malloc(sizeof(int)*(size_t)(n ? n : 1));
+    uint32_t* prog = (uint32_t*)malloc(sizeof(uint32_t)*(size_t)(n ? n : 1));
+    float* mark = (float*)malloc(sizeof(float)*(size_t)(n ? n : 1));
+    size_t* name_off = (size_t*)malloc(sizeof(size_t)*(size_t)(n+1));
+    int* at_slot = (h.flags & CMPT_SLOTS) ? (int*)malloc(sizeof(int)*(size_t)(n ? n : 1)) : NULL;
+    ok = prog_at && prog_len && id && prog && mark && name_off && (at_slot || !(h.flags & CMPT_SLOTS));
+
+    ByteReader r = {payload, payload + (size_t)h.raw_size, 0};
+    for (int p=0; ok && p<np; ++p) {
+        prog_len[p] = (size_t)br_varint(&r);
+        ok = prog_len[p] < MAX_PROG && (prog_at[p] = br_bytes(&r, prog_len[p])) != NULL;
+    }
+    int64_t prev = 0;
+    for (int k=0; ok && k<n; ++k) {
+        uint64_t u = br_varint(&r);
+        int64_t x = k == 0 ? ((u & 1) ? -(int64_t)(u >> 1) - 1 : (int64_t)(u >> 1)) : prev + (int64_t)(u & 0xffffffffu);
+        ok = !r.bad && (k == 0 || u <= 0xffffffffu) && x >= INT_MIN && x <= INT_MAX;
+        id[k] = (int)x;
+        prev = x;
+    }
+    for (int k=0; ok && k<n; ++k) { uint64_t p = br_varint(&r); prog[k] = (uint32_t)p; ok = !r.bad && p < (uint64_t)np; }
+    const unsigned char* marks = ok ? br_bytes(&r, (size_t)n * ((h.flags & CMPT_FLOAT_MARKS) ? 4 : 2)) : NULL;
+    ok = ok && marks;
+    for (int k=0; ok && k<n; ++k) {
+        if (h.flags & CMPT_FLOAT_MARKS) { uint32_t bits = get_le32(marks + 4*(size_t)k); memcpy(&mark[k], &bits, 4); }
+        else mark[k] = mark_from_hundredths((unsigned)marks[2*k] | (unsigned)marks[2*k+1] << 8);
+    }
+    if (ok) name_off[0] = 0;
+    for (int k=0; ok && k<n; ++k) {
+        uint64_t len = br_varint(&r);
+        ok = !r.bad && len < MAX_NAME;
+        name_off[k+1] = name_off[k] + (size_t)len;
+    }
+    const unsigned char* names = ok ? br_bytes(&r, name_off[n]) : NULL;
+    ok = ok && names;
+    if (ok && at_slot) {
+        for (int i=0;i<n;++i) at_slot[i] = -1;
+        for (int k=0; ok && k<n; ++k) {
+            uint64_t slot = br_varint(&r);
+            ok = !r.bad && slot < (uint64_t)n && at_slot[slot] < 0;
+            if (ok) at_slot[slot] = k;
+        }
+    }
+    ok = ok && !r.bad && r.p == r.end && records_reserve(n);
+
+    if (ok) {
+        store_clear();
+        id_index_reserve(n);
+        for (int i=0;i<n;++i) {
+            int k = at_slot ? at_slot[i] : i;
+            Student s;
+            s.id = id[k];
+            s.mark = mark[k];
+            size_t len = name_off[k+1] - name_off[k];
+            memcpy(s.name, names + name_off[k], len);
+            s.name[len] = 0;
+            memcpy(s.programme, prog_at[prog[k]], prog_len[prog[k]]);
+            s.programme[prog_len[prog[k]]] = 0;
+            if (id_index_get(s.id) >= 0) {
+                out_printf("CMS: Warning: duplicate ID=%d in record %d, skipped.\n", s.id, i+1);
+                continue;
+            }
+            if (store_append(&s) < 0) {
+                out_printf("CMS: Warning: out of memory at record %d, remaining records not loaded.\n", i+1);
+                break;
+            }
+        }
+        snapshot_bytes = (long)v.size;
+    }
+    free(prog_at); free(prog_len); free(id); free(prog); free(mark); free(name_off); free(at_slot);
+    free(raw);
+    file_view_close(&v);
+    return ok ? 1 : -1;
+}
+
+/* ---- Chunked text loader ----
+ * The file is split at newline boundaries into a few chunks per worker,
+ * parsed as pool tasks. Each task parses its chunk into a local buffer
+ * (rows plus the line numbers of malformed rows); the buffers are then
+ * merged into the store in file order, which is where duplicate IDs are
+ * detected, so warnings match a serial load. */
+#define LOAD_CHUNK_MIN (256L*1024)   /* below this a chunk is not worth a task */
+
+typedef struct {
+    const char* begin;
+    const char* end;
+    Student* rows;
+    int* row_line;      /* chunk-local line number of each row */
+    int n_rows, cap_rows;
+    int* bad_line;      /* chunk-local line numbers of malformed rows */
+    int n_bad, cap_bad;
+    int n_lines;
+    int failed;         /* out of memory */
+} LoadChunk;
+
+static int load_chunk_push_row(LoadChunk* c, const Student* s, int line) {
+    if (c->n_rows == c->cap_rows) {
+        int cap = c->cap_rows ? c->cap_rows*2 : 256;
+        Student* r = (Student*)realloc(c->rows, sizeof(Student)*(size_t)cap);
+        if (!r) return 0;
+        c->rows = r;
+        int* l = (int*)realloc(c->row_line, sizeof(int)*(size_t)cap);
+        if (!l) return 0;
+        c->row_line = l;
+        c->cap_rows = cap;
+    }
+    c->rows[c->n_rows] = *s;
+    c->row_line[c->n_rows++] = line;
+    return 1;
+}
+
+static int load_chunk_push_bad(LoadChunk* c, int line) {
+    if (c->n_bad == c->cap_bad) {
+        int cap = c->cap_bad ? c->cap_bad*2 : 16;
+        int* l = (int*)realloc(c->bad_line, sizeof(int)*(size_t)cap);
+        if (!l) return 0;
+        c->bad_line = l; c->cap_bad = cap;
+    }
+    c->bad_line[c->n_bad++] = line;
+    return 1;
+}
+
+static void load_chunk_task(void* ctx, int task) {
+    LoadChunk* c = (LoadChunk*)ctx + task;
+    const char* p = c->begin;
+    char line[MAX_LINE];
+    while (p < c->end && !c->failed) {
+        const char* nl = (const char*)memchr(p, '\n', (size_t)(c->end - p));
+        const char* e = nl ? nl : c->end;
+        size_t len = (size_t)(e - p); if (len > MAX_LINE-1) len = MAX_LINE-1;
+        memcpy(line, p, len); line[len] = '\0';
+        p = nl ? nl+1 : c->end;
+        c->n_lines++;
+        trim(line); if (!line[0]) continue;
+        Student s;
+        int ok = parse_db_line(line, &s) ? load_chunk_push_row(c, &s, c->n_lines)
+                                         : load_chunk_push_bad(c, c->n_lines);
+        if (!ok) c->failed = 1;
+    }
+}
+
+static int load_db_text(const char* filename) {
+    FileView v;
+    if (!file_view_open(filename, &v)) return 0;
+    const char* data = (const char*)v.data;
+
+    int n_chunks = worker_count() > 1 ? worker_count()*4 : 1;   /* spare chunks to steal */
+    if ((long)(v.size / LOAD_CHUNK_MIN) < n_chunks) n_chunks = (int)(v.size / LOAD_CHUNK_MIN);
+    if (n_chunks < 1) n_chunks = 1;
+    LoadChunk* chunks = (LoadChunk*)calloc((size_t)n_chunks, sizeof(LoadChunk));
+    if (!chunks) {
+        file_view_close(&v);
+        out_printf("CMS: Memory error.\n");
+        return 0;
+    }
+
+    /* cut at the first newline after each even split point */
+    const char* cut = data;
+    for (int k=0;k<n_chunks;++k) {
+        chunks[k].begin = cut;
+        const char* end = data + v.size;
+        if (k < n_chunks-1) {
+            const char* target = data + v.size / (size_t)n_chunks * (size_t)(k+1);
+            if (target < cut) target = cut;
+            const char* nl = (const char*)memchr(target, '\n', (size_t)(end - target));
+            if (nl) end = nl+1;
+        }
+        chunks[k].end = end;
+        cut = end;
+    }
+    pool_run(n_chunks, load_chunk_task, chunks);
+
+    /* merge in file order */
+    size_t total = 0;
+    for (int k=0;k<n_chunks;++k) total += (size_t)chunks[k].n_rows;
+    store_clear();
+    if (total > (size_t)INT_MAX) total = INT_MAX;
+    records_reserve((int)total);
+    id_index_reserve((int)total);
+    int line_base = 0, stop = 0;
+    for (int k=0;k<n_chunks && !stop;++k) {
+        LoadChunk* c = &chunks[k];
+        int r = 0, b = 0;
+        while (r < c->n_rows || b < c->n_bad) {
+            if (b < c->n_bad && (r >= c->n_rows || c->bad_line[b] < c->row_line[r])) {
+                out_printf("CMS: Warning: line %d is malformed, skipped.\n", line_base + c->bad_line[b++]);
+                continue;
+            }
+            const Student* s = &c->rows[r];
+            int line_no = line_base + c->row_line[r++];
+            if (find_index_by_id(s->id)>=0) {
+                out_printf("CMS: Warning: duplicate ID=%d on line %d, skipped.\n", s->id, line_no);
+                continue;
+            }
+            if (store_append(s) < 0) {
+                out_printf("CMS: Warning: out of memory at line %d, remaining records not loaded.\n", line_no);
+                stop = 1;
+                break;
+            }
+        }
+        if (c->failed && !stop) {
+            out_printf("CMS: Warning: out of memory after line %d, remaining records not loaded.\n", line_base + c->n_lines);
+            stop = 1;
+        }
+        line_base += c->n_lines;
+    }
+    for (int k=0;k<n_chunks;++k) {
+        free(chunks[k].rows); free(chunks[k].row_line); free(chunks[k].bad_line);
+    }
+    free(chunks);
+    snapshot_bytes = (long)v.size;
+    file_view_close(&v);
+    records_shrink_to_fit();
+    return 1;
+}
+
+static int save_db_text(const StoreSnap* s, const char* filename, long* bytes) {
+    FILE* f = fopen(filename,"w");
+    if (!f) return 0;
+    OutBuf* o = (OutBuf*)malloc(sizeof(OutBuf));
+    if (!o) { fclose(f); return 0; }
+    o->fp = f; o->len = 0;
+    for (int i=0;i<s->n;++i) {
+        /* "%d|%s|%s|%.2f\n" */
+        char* p = out_room(o);
+        p = fmt_int(p, s->id[i], 0); *p++ = '|';
+        p = fmt_str(p, snap_name(s, i), 0, -1); *p++ = '|';
+        p = fmt_str(p, snap_prog(s, i), 0, -1); *p++ = '|';
+        p = fmt_mark(p, s->mark[i], 0); *p++ = '\n';
+        out_commit(o, p);
+    }
+    int ok = out_flush(o);
+    free(o);
+    *bytes = ftell(f);
+    if (ok) ok = fflush(f) == 0 && fsync_file(f) == 0;
+    if (fclose(f) != 0) ok = 0;
+    return ok;
+}
+
+/* returns 1 when loaded, 0 when the file does not exist, -1 when it is not a valid snapshot */
+static int load_db(const char* filename) {
+    FILE* f = fopen(filename, "rb");
+    if (!f) return 0;
+    char magic[4];
+    size_t got = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+    int loaded;
+    if (got == sizeof(magic) && memcmp(magic, BIN_MAGIC, 4) == 0) {
+        db_format = FMT_BINARY;
+        loaded = load_db_binary(filename);
+    } else if (got == sizeof(magic) && memcmp(magic, CMPT_MAGIC, 4) == 0) {
+        int lz = 0;
+        loaded = load_db_compact(filename, &lz);
+        db_format = lz ? FMT_COMPACT_LZ : FMT_COMPACT;
+    } else {
+        db_format = FMT_TEXT;
+        loaded = load_db_text(filename);
+    }
+    if (loaded > 0) { io_stats.loads++; io_stats.load_bytes += snapshot_bytes; }
+    return loaded;
+}
+
+static int save_db(const StoreSnap* s, DbFormat format, const char* filename, long* bytes) {
+    switch (format) {
+    case FMT_BINARY: return save_db_binary(s, filename, bytes);
+    case FMT_COMPACT: return save_db_compact(s, 0, filename, bytes);
+    case FMT_COMPACT_LZ: return save_db_compact(s, 1, filename, bytes);
+    default: return save_db_text(s, filename, bytes);
+    }
+}
+
+/* ---- Write-ahead journal: <Team>-CMS.journal ----
+ * Under AUTOSAVE each mutation appends one line instead of rewriting the
+ * database:  "P|ID|Name|Programme|Mark" (insert/replace) or "D|ID" (delete).
+ * OPEN replays it on top of the snapshot; SAVE (or the size threshold)
+ * folds it back into a fresh snapshot and empties it. */
+#define JOURNAL_COMPACT_MIN (1L<<20)
+
+static FILE* journal_fp = NULL;
+static long journal_bytes = 0;
+static int journal_stale = 0;      /* changes made while AUTOSAVE was off are not in snapshot+journal */
+static int fsync_every = 0;        /* 0 = never fsync, n = fsync every n journal appends */
+static int appends_since_sync = 0;
+static int journal_batch = 0;      /* inside a block: entries are staged, then written B..C at once */
+static char* batch_buf = NULL;
+static size_t batch_len = 0, batch_cap = 0;
+
+static int journal_open(void) {
+    if (journal_fp) return 1;
+    if (!journal_filename[0]) return 0;
+    journal_fp = fopen(journal_filename, "a");
+    if (!journal_fp) return 0;
+    fseek(journal_fp, 0, SEEK_END);
+    journal_bytes = ftell(journal_fp);
+    return 1;
+}
+
+static void journal_close(void) {
+    if (journal_fp) { fclose(journal_fp); journal_fp = NULL; }
+    appends_since_sync = 0;
+}
+
+/* empty the journal once its contents are part of the snapshot */
+static int journal_truncate(void) {
+    journal_close();
+    journal_bytes = 0;
+    journal_stale = 0;
+    if (!journal_filename[0]) return 1;
+    FILE* f = fopen(journal_filename, "w");
+    if (!f) return 0;
+    fclose(f);
+    return 1;
+}
+
+static int batch_append(const char* text, size_t n) {
+    if (batch_len + n > batch_cap) {
+        size_t cap = batch_cap ? batch_cap : 4096;
+        while (cap < batch_len + n) cap *= 2;
+        char* b = (char*)realloc(batch_buf, cap);
+        if (!b) return 0;
+        batch_buf = b; batch_cap = cap;
+    }
+    memcpy(batch_buf + batch_len, text, n);
+    batch_len += n;
+    return 1;
+}
+
+static void journal_emit(const char* rec, int n) {
+    if (!autosave_on || journal_stale || !journal_open()) { journal_stale = 1; return; }
+    if (n < 0) { journal_stale = 1; return; }
+    if (journal_batch) {
+        if (!batch_append(rec, (size_t)n)) journal_stale = 1;
+        return;
+    }
+    if (fwrite(rec, 1, (size_t)n, journal_fp) != (size_t)n) { journal_stale = 1; return; }
+    journal_bytes += n;
+    io_stats.journal_bytes += n;
+    appends_since_sync++;
+}
+
+static void journal_put(const Student* s) {
+    char rec[MAX_LINE];
+    int n = snprintf(rec, sizeof(rec), "P|%d|%s|%s|%.2f\n", s->id, s->name, s->programme, s->mark);
+    journal_emit(rec, n < (int)sizeof(rec) ? n : -1);
+}
+
+static void journal_del(int id) {
+    char rec[32];
+    journal_emit(rec, snprintf(rec, sizeof(rec), "D|%d\n", id));
+}
+
+/* group the following entries so replay applies all of them or none */
+static void journal_block_begin(void) {
+    journal_batch = 1;
+    batch_len = 0;
+}
+
+/* write the staged block (keep) or drop it (ROLLBACK) */
+static void journal_block_end(int keep) {
+    journal_batch = 0;
+    if (keep && batch_len > 0 && !journal_stale && journal_open()) {
+        if (fputs("B\n", journal_fp) < 0 ||
+            fwrite(batch_buf, 1, batch_len, journal_fp) != batch_len ||
+            fputs("C\n", journal_fp) < 0) {
+            journal_stale = 1;
+        } else {
+            journal_bytes += (long)batch_len + 4;
+            io_stats.journal_bytes += (long long)batch_len + 4;
+            appends_since_sync++;
+        }
+    }
+    batch_len = 0;
+}
+
+/* make appended entries durable according to the fsync policy */
+static int journal_commit(void) {
+    if (!journal_fp) return 1;
+    if (fflush(journal_fp) != 0) return 0;
+    if (fsync_every > 0 && appends_since_sync >= fsync_every) {
+        if (fsync_file(journal_fp) != 0) return 0;
+        appends_since_sync = 0;
+    }
+    return 1;
+}
+
+/* rename over an existing file in one step */
+static int replace_file(const char* from, const char* to) {
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+/* drop the first cut bytes of the journal, which a new snapshot now covers */
+static int journal_drop_prefix(long cut) {
+    if (!journal_filename[0]) return 1;
+    if (journal_fp && fflush(journal_fp) != 0) return 0;
+    if (cut >= journal_bytes) return journal_truncate();
+    char tmp[sizeof(journal_filename)+4];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", journal_filename);
+    FILE* in = fopen(journal_filename, "rb");
+    FILE* out = in ? fopen(tmp, "wb") : NULL;
+    int ok = in && out && fseek(in, cut, SEEK_SET) == 0;
+    char buf[8192];
+    size_t n;
+    while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0) ok = fwrite(buf, 1, n, out) == n;
+    if (in) fclose(in);
+    if (out && fclose(out) != 0) ok = 0;
+    journal_close();
+    if (ok) ok = replace_file(tmp, journal_filename);
+    if (!ok) remove(tmp);
+    return ok;   /* journal_open re-reads the size */
+}
+
+/* ---- Background saves ----
+ * SAVE and autosave compaction copy the store (under the exclusive lock)
+ * and a worker thread writes the copy to "<file>.tmp", syncs it and renames
+ * it over the database, so a crash mid-save leaves the old file intact.
+ * A request made while a save runs snapshots at once and waits behind it;
+ * a newer request replaces a waiting one, so at most two are in flight.
+ * The journal keeps growing meanwhile; once the snapshot lands, the journal
+ * prefix it covers is dropped by the next command that holds the exclusive
+ * lock (replaying that prefix over the new snapshot is harmless: every
+ * entry sets or deletes a whole record). If the journal was stale when the
+ * copy was taken it cannot be replayed over the new snapshot, so the worker
+ * empties it right after the rename. Results are queued as notices and
+ * printed before the requesting session's next prompt. */
+#define SAVE_WAITERS 16
+
+typedef struct {
+    StoreSnap snap;
+    DbFormat format;
+    char filename[sizeof(db_filename)];
+    char journal[sizeof(journal_filename)];
+    long cut;               /* journal bytes the snapshot covers */
+    int was_stale;
+    unsigned long epoch;
+    struct { int client, autosave; } waiter[SAVE_WAITERS];   /* who asked for it; coalesced requests add theirs */
+    int n_waiters;
+    int ok;                 /* results, written by the worker */
+    long bytes;
+} SaveJob;
+
+#define SAVE_NOTICES (2*SAVE_WAITERS)
+
+static cms_mutex save_lock = CMS_MUTEX_INIT;   /* save_done and the notices */
+static SaveJob save_job;
+static cms_thread save_thread;
+static int save_busy = 0;       /* save_job's worker was started and not yet joined */
+static int save_done = 0;       /* ... and has finished */
+static SaveJob save_next;        /* snapshot waiting for the running save */
+static int save_queued = 0;
+static struct { int client; char text[sizeof(db_filename)+96]; } save_notices[SAVE_NOTICES];
+static int n_save_notices = 0;
+
+static void save_notice(int client, const char* text) {
+    cms_mutex_lock(&save_lock);
+    if (n_save_notices == SAVE_NOTICES) {   /* nobody collected the oldest */
+        memmove(save_notices, save_notices+1, sizeof(save_notices[0])*(SAVE_NOTICES-1));
+        n_save_notices--;
+    }
+    save_notices[n_save_notices].client = client;
+    snprintf(save_notices[n_save_notices].text, sizeof(save_notices[0].text), "%s", text);
+    n_save_notices++;
+    cms_mutex_unlock(&save_lock);
+}
+
+/* prints the finished saves the current session asked for */
+static void save_report(void) {
+    cms_mutex_lock(&save_lock);
+    int w = 0;
+    for (int i=0;i<n_save_notices;++i) {
+        if (save_notices[i].client == session->client) out_printf("%s", save_notices[i].text);
+        else save_notices[w++] = save_notices[i];
+    }
+    n_save_notices = w;
+    cms_mutex_unlock(&save_lock);
+}
+
+static void* save_worker(void* arg) {
+    SaveJob* j = (SaveJob*)arg;
+    char tmp[sizeof(j->filename)+4], text[sizeof(save_notices[0].text)];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", j->filename);
+    j->bytes = 0;
+    j->ok = save_db(&j->snap, j->format, tmp, &j->bytes) && replace_file(tmp, j->filename);
+    if (!j->ok) remove(tmp);
+    if (j->ok && j->was_stale && j->journal[0]) {
+        FILE* f = fopen(j->journal, "w");
+        if (f) fclose(f); else j->ok = 0;
+    }
+    if (j->ok) {
+        cms_mutex_lock(&misc_lock);
+        io_stats.saves++;
+        io_stats.save_bytes += j->bytes;
+        cms_mutex_unlock(&misc_lock);
+    }
+    for (int w=0; w<j->n_waiters; ++w) {
+        if (j->waiter[w].autosave) {
+            if (j->ok) snprintf(text, sizeof(text), "CMS: Autosave complete → \"%s\".\n", j->filename);
+            else snprintf(text, sizeof(text), "CMS: Autosave FAILED. Please SAVE manually and check permissions.\n");
+        } else {
+            if (j->ok) snprintf(text, sizeof(text), "CMS: The database file \"%s\" is successfully saved.\n", j->filename);
+            else snprintf(text, sizeof(text), "CMS: Failed to save database file \"%s\". Check permissions.\n", j->filename);
+        }
+        save_notice(j->waiter[w].client, text);
+    }
+    cms_mutex_lock(&save_lock);
+    save_done = 1;
+    cms_mutex_unlock(&save_lock);
+    return NULL;
+}
+
+/* journal bookkeeping once the snapshot is (or failed to be) in place; exclusive lock
+   held. Returns how many bytes were cut from the front of the journal. */
+static long save_finish(SaveJob* j) {
+    long dropped = 0;
+    if (j->ok) {
+        snapshot_bytes = j->bytes;
+        if (j->was_stale) {
+            dropped = journal_bytes;   /* the worker emptied it; nothing was appended while stale */
+            journal_close();
+            journal_bytes = 0;
+            journal_stale = store_epoch != j->epoch;   /* still stale if changed since the copy */
+        } else {
+            int stale = journal_stale;   /* changes since the copy may have gone unjournaled */
+            if (journal_drop_prefix(j->cut)) dropped = j->cut;
+            else stale = 1;
+            journal_stale = stale;
+        }
+    }
+    snap_free(&j->snap);
+    return dropped;
+}
+
+static void save_launch(void) {
+    save_done = 0;
+    if (cms_thread_start(&save_thread, save_worker, &save_job)) {
+        save_busy = 1;
+        return;
+    }
+    save_worker(&save_job);   /* no thread: write it here */
+    save_finish(&save_job);
+}
+
+/* joins the running save (waiting if needed) and starts the queued one; exclusive lock held */
+static void save_collect(void) {
+    cms_thread_join(&save_thread);
+    save_busy = 0;
+    long dropped = save_finish(&save_job);
+    if (save_queued) {
+        save_queued = 0;
+        save_job = save_next;
+        save_job.cut = save_job.cut > dropped ? save_job.cut - dropped : 0;
+        if (save_job.was_stale) journal_stale = 1;   /* its worker empties the journal: append nothing meanwhile */
+        save_launch();
+    }
+}
+
+/* the running save has finished and waits for save_collect; any lock on db_lock held */
+static int save_finished(void) {
+    if (!save_busy) return 0;
+    cms_mutex_lock(&save_lock);
+    int done = save_done;
+    cms_mutex_unlock(&save_lock);
+    return done;
+}
+
+/* save_collect if the running save has finished; called before every write command,
+   and before a read when it finished, so a queued save does not wait for the next write */
+static void save_reap(void) {
+    if (save_finished()) save_collect();
+}
+
+/* waits for the running and queued saves (OPEN, EXIT); exclusive lock held */
+static void save_drain(void) {
+    while (save_busy) save_collect();
+}
+
+/* snapshots the store for db_filename and writes it in the background.
+   Returns 0 when another save is running: this one waits behind it,
+   replacing any save already waiting there but keeping its requesters,
+   so each of them is told how the save went. */
+static int save_start(int client, int autosave) {
+    SaveJob j;
+    memset(&j, 0, sizeof(j));
+    store_compact();
+    j.format = db_format;
+    snprintf(j.filename, sizeof(j.filename), "%s", db_filename);
+    snprintf(j.journal, sizeof(j.journal), "%s", journal_filename);
+    if (journal_fp) fflush(journal_fp);
+    j.cut = journal_bytes;
+    j.was_stale = journal_stale;
+    j.epoch = store_epoch;
+    j.waiter[0].client = client;
+    j.waiter[0].autosave = autosave;
+    j.n_waiters = 1;
+    if (!snap_copy(&j.snap)) {
+        save_drain();          /* no memory for a copy: write the live store in place */
+        snap_live(&j.snap);
+        save_job = j;
+        save_worker(&save_job);
+        save_finish(&save_job);
+        return 1;
+    }
+    if (save_busy && save_queued && save_next.n_waiters == SAVE_WAITERS) save_collect();   /* no room: start the queued one */
+    if (save_busy) {
+        if (save_queued) {
+            for (int w=0; w<save_next.n_waiters; ++w) {
+                int dup = 0;
+                for (int k=0; k<j.n_waiters; ++k) dup |= j.waiter[k].client == save_next.waiter[w].client &&
+                                                        j.waiter[k].autosave == save_next.waiter[w].autosave;
+                if (!dup) j.waiter[j.n_waiters++] = save_next.waiter[w];
+            }
+            snap_free(&save_next.snap);
+        }
+        save_next = j;
+        save_queued = 1;
+        return 0;
+    }
+    save_job = j;
+    save_launch();
+    return 1;
+}
+
+typedef struct {
+    char op;     /* 'P' put or 'D' delete */
+    Student s;   /* D uses only s.id */
+} JournalOp;
+
+static int journal_apply(const JournalOp* j) {
+    int idx = find_index_by_id(j->s.id);
+    if (j->op == 'D') {
+        if (idx >= 0) store_remove_at(idx);
+        return 1;
+    }
+    return idx >= 0 ? store_set(idx, &j->s) : store_append(&j->s) >= 0;
+}
+
+/* re-apply journal entries after load_db; a torn final line stops replay.
+   Entries between B and C lines (a committed transaction) are held back
+   and applied only once the C line is read. */
+static int journal_replay(void) {
+    FILE* f = fopen(journal_filename, "r");
     if (!f) return 0;
     char line[MAX_LINE];
-    n_records = 0;
+    int applied = 0, line_no = 0;
+    int in_block = 0, held = 0, held_cap = 0;
+    JournalOp* pending = NULL;
     while (fgets(line,sizeof(line),f)) {
+        line_no++;
+        size_t len = strlen(line);
+        int complete = len>0 && line[len-1]=='\n';
         trim(line); if (!line[0]) continue;
-        char* p1 = strtok(line,"|");
-        char* p2 = strtok(NULL,"|");
-        char* p3 = strtok(NULL,"|");
-        char* p4 = strtok(NULL,"|");
-        if (!p1||!p2||!p3||!p4) continue;
-        Student s; s.id=atoi(p1);
-        strncpy(s.name,p2,MAX_NAME-1); s.name[MAX_NAME-1]=0;
-        strncpy(s.programme,p3,MAX_PROG-1); s.programme[MAX_PROG-1]=0;
-        s.mark=(float)atof(p4);
-        if (n_records<MAX_RECORDS) records[n_records++]=s;
+        JournalOp j;
+        if (complete && line[0]=='B' && !line[1] && !in_block) { in_block = 1; held = 0; continue; }
+        if (complete && line[0]=='C' && !line[1] && in_block) {
+            int k = 0;
+            for (; k<held; ++k) if (!journal_apply(&pending[k])) break;
+            applied += k;
+            in_block = 0;
+            if (k < held) { out_printf("CMS: Warning: out of memory replaying journal.\n"); break; }
+            continue;
+        }
+        if (complete && line[0]=='P' && line[1]=='|' && parse_db_line(line+2, &j.s)) {
+            j.op = 'P';
+        } else if (complete && line[0]=='D' && line[1]=='|') {
+            j.op = 'D'; j.s.id = atoi(line+2);
+        } else {
+            out_printf("CMS: Warning: journal line %d is incomplete or malformed, replay stopped.\n", line_no);
+            break;
+        }
+        if (in_block) {
+            if (held == held_cap) {
+                int cap = held_cap ? held_cap*2 : 64;
+                JournalOp* p = (JournalOp*)realloc(pending, sizeof(JournalOp)*(size_t)cap);
+                if (!p) { out_printf("CMS: Warning: out of memory replaying journal.\n"); break; }
+                pending = p; held_cap = cap;
+            }
+            pending[held++] = j;
+            continue;
+        }
+        if (!journal_apply(&j)) {
+            out_printf("CMS: Warning: out of memory replaying journal.\n");
+            break;
+        }
+        applied++;
     }
+    if (in_block) out_printf("CMS: Warning: journal ends inside an uncommitted transaction, its entries were skipped.\n");
+    free(pending);
+    store_compact();
+    journal_bytes = ftell(f);
+    io_stats.replays++;
+    io_stats.replay_bytes += journal_bytes;
     fclose(f);
+    return applied;
+}
+
+/* BEGIN..COMMIT: mutations collect here and reach the undo stack as one OP_GROUP */
+static int txn_open = 0;
+static int txn_owner = 0;   /* session->client that ran BEGIN */
+static UndoEntry* txn_log = NULL;
+static int txn_n = 0, txn_cap = 0;
+
+static void undo_entry_free(UndoEntry* e) {
+    for (int j=0; e->type==OP_GROUP && j<e->count; ++j) undo_entry_free(&e->group[j]);
+    if (e->type==OP_GROUP) free(e->group);
+    if (e->type==OP_IMPORT) { free(e->ids); free(e->marks); }
+    free(e->text);
+    e->group = NULL; e->ids = NULL; e->marks = NULL; e->text = NULL;
+}
+
+/* bytes an entry holds, its own slot included */
+static size_t undo_entry_bytes(const UndoEntry* e) {
+    size_t b = sizeof(UndoEntry);
+    int strings = e->type==OP_UPDATE ? 2*(((e->changed & UF_NAME) != 0) + ((e->changed & UF_PROG) != 0))
+                : (e->type==OP_INSERT || e->type==OP_DELETE) ? 2
+                : (e->type==OP_IMPORT && e->marks) ? 2*e->count : 0;
+    const char* t = e->text;
+    for (int k=0; t && k<strings; ++k) { size_t len = strlen(t)+1; b += len; t += len; }
+    if (e->type==OP_IMPORT) b += (size_t)e->count*(sizeof(int) + (e->marks ? sizeof(float) : 0));
+    if (e->type==OP_GROUP) for (int j=0;j<e->count;++j) b += undo_entry_bytes(&e->group[j]);
+    return b;
+}
+
+/* INSERT/DELETE step; type OP_NONE when out of memory */
+static UndoEntry undo_record(OpType type, const Student* s) {
+    UndoEntry u = {0};
+    size_t ln = strlen(s->name)+1, lp = strlen(s->programme)+1;
+    u.text = (char*)malloc(ln+lp);
+    if (!u.text) return u;
+    memcpy(u.text, s->name, ln);
+    memcpy(u.text+ln, s->programme, lp);
+    u.type = type; u.id = s->id; u.mark[0] = s->mark;
+    return u;
+}
+
+/* UPDATE step holding only the fields that differ; type OP_NONE when out of memory */
+static UndoEntry undo_update(const Student* before, const Student* after) {
+    UndoEntry u = {0};
+    const char* str[4];
+    int n = 0;
+    if (strcmp(before->name, after->name) != 0) {
+        u.changed |= UF_NAME; str[n++] = before->name; str[n++] = after->name;
+    }
+    if (strcmp(before->programme, after->programme) != 0) {
+        u.changed |= UF_PROG; str[n++] = before->programme; str[n++] = after->programme;
+    }
+    if (before->mark != after->mark) u.changed |= UF_MARK;
+    if (n) {
+        size_t len = 0;
+        for (int k=0;k<n;++k) len += strlen(str[k])+1;
+        u.text = (char*)malloc(len);
+        if (!u.text) return u;
+        char* t = u.text;
+        for (int k=0;k<n;++k) { size_t l = strlen(str[k])+1; memcpy(t, str[k], l); t += l; }
+    }
+    u.type = OP_UPDATE; u.id = before->id;
+    u.mark[0] = before->mark; u.mark[1] = after->mark;
+    return u;
+}
+
+/* the record before (after=0) or after a step. UPDATE only overwrites the
+   fields it changed, so s must already hold the current record */
+static void undo_side(const UndoEntry* u, int after, Student* s) {
+    const char* t = u->text;
+    s->id = u->id;
+    if (u->type != OP_UPDATE) {
+        snprintf(s->name, sizeof(s->name), "%s", t);
+        snprintf(s->programme, sizeof(s->programme), "%s", t+strlen(t)+1);
+        s->mark = u->mark[0];
+        return;
+    }
+    if (u->changed & UF_NAME) {
+        const char* v = t + strlen(t)+1;
+        snprintf(s->name, sizeof(s->name), "%s", after ? v : t);
+        t = v + strlen(v)+1;
+    }
+    if (u->changed & UF_PROG) {
+        const char* v = t + strlen(t)+1;
+        snprintf(s->programme, sizeof(s->programme), "%s", after ? v : t);
+    }
+    if (u->changed & UF_MARK) s->mark = u->mark[after];
+}
+
+static void undo_drop_oldest(void) {
+    UndoEntry* e = &UNDO_AT(0);
+    undo_bytes -= undo_entry_bytes(e);
+    undo_entry_free(e);
+    undo_base = (undo_base+1) & (undo_cap-1);
+    undo_n--;
+}
+
+/* forgets the undone steps; a new change makes them unreachable */
+static void redo_clear(void) {
+    for (int i=0;i<redo_n;++i) {
+        UndoEntry* e = &UNDO_AT(undo_n+i);
+        undo_bytes -= undo_entry_bytes(e);
+        undo_entry_free(e);
+    }
+    redo_n = 0;
+}
+
+static int undo_grow(void) {
+    int cap = undo_cap ? undo_cap*2 : 64;
+    UndoEntry* r = (UndoEntry*)malloc(sizeof(UndoEntry)*(size_t)cap);
+    if (!r) return 0;
+    for (int i=0;i<undo_n+redo_n;++i) r[i] = UNDO_AT(i);
+    free(undo_ring);
+    undo_ring = r; undo_cap = cap; undo_base = 0;
     return 1;
 }
 
-static int save_db(const char* filename) {
-    FILE* f = fopen(filename,"w");
-    if (!f) return 0;
-    for (int i=0;i<n_records;++i) {
-        fprintf(f,"%d|%s|%s|%.2f\n", records[i].id, records[i].name, records[i].programme, records[i].mark);
-    }
-    fclose(f);
-    return 1;
+static void push_undo(UndoEntry e) {
+    if (e.type == OP_NONE) {   /* the builder ran out of memory */
+        out_printf("CMS: Warning: out of memory, this change cannot be undone.\n");
+        return;
+    }
+    if (txn_open) {
+        if (txn_n == txn_cap) {
+            int cap = txn_cap ? txn_cap*2 : 64;
+            UndoEntry* t = (UndoEntry*)realloc(txn_log, sizeof(UndoEntry)*(size_t)cap);
+            if (!t) {
+                out_printf("CMS: Warning: out of memory, this change cannot be rolled back.\n");
+                undo_entry_free(&e);
+                return;
+            }
+            txn_log = t; txn_cap = cap;
+        }
+        txn_log[txn_n++] = e;
+        return;
+    }
+    redo_clear();
+    size_t bytes = undo_entry_bytes(&e);
+    /* the newest step is always kept, even when it alone is over budget */
+    while (undo_n > 0 && undo_bytes + bytes > undo_budget) undo_drop_oldest();
+    if (undo_n == undo_cap && !undo_grow()) {
+        if (!undo_n) {
+            out_printf("CMS: Warning: out of memory, this change cannot be undone.\n");
+            undo_entry_free(&e);
+            return;
+        }
+        undo_drop_oldest();
+    }
+    UNDO_AT(undo_n) = e;
+    undo_n++;
+    undo_bytes += bytes;
+}
+
+static void maybe_autosave(void) {
+    if (txn_open) return;   /* COMMIT saves once for the whole transaction */
+    if (autosave_on && db_filename[0]) {
+        int ok = 1, started = 0;
+        double t0 = cms_now_ms();
+        save_reap();
+        /* snapshot is behind (or journal too long): fold everything into a fresh snapshot.
+           A save already running will shorten the journal, unless the journal is stale. */
+        if (journal_stale || (!save_busy && journal_bytes > JOURNAL_COMPACT_MIN && journal_bytes > snapshot_bytes)) {
+            save_start(session->client, 1);
+            started = 1;
+            io_stats.autosave_compactions++;
+        } else {
+            ok = journal_commit();
+        }
+        double ms = cms_now_ms() - t0;
+        io_stats.autosaves++;
+        io_stats.autosave_ms += ms;
+        if (ms > io_stats.autosave_max_ms) io_stats.autosave_max_ms = ms;
+        if (started) {
+            /* the background save reports when it is done */
+        } else if (ok) {
+            out_printf("CMS: Autosave complete → \"%s\".\n", journal_filename);
+        } else {
+            journal_stale = 1;
+            out_printf("CMS: Autosave FAILED. Please SAVE manually and check permissions.\n");
+        }
+    }
+}
+
+static void print_record_header(void) {
+    /* Fixed-width columns so long names/programmes do not break alignment.
+       Names/programmes may be visually truncated in SHOW ALL but the full value
+       remains stored and is visible via QUERY. */
+    out_printf("%-7s  %-35s  %-25s  %-5s\n",
+           "ID", "Name", "Programme", "Mark");
+}
+
+/* one SHOW-style row into the session's row buffer: "%07d  %-35.35s  %-25.25s  %5.2f\n".
+   Callers flush it when their listing ends. */
+static void print_record(int i) {
+    char* p = out_room(session->rows);
+    p = fmt_int(p, col_id[i], 7);
+    *p++ = ' '; *p++ = ' ';
+    p = fmt_str(p, rec_name(i), 35, 35);
+    *p++ = ' '; *p++ = ' ';
+    p = fmt_str(p, rec_prog(i), 25, 25);
+    *p++ = ' '; *p++ = ' ';
+    p = fmt_mark(p, col_mark[i], 5);
+    *p++ = '\n';
+    out_commit(session->rows, p);
+}
+
+
+
+static void visit_print(int slot, void* ctx) {
+    (void)ctx;
+    print_record(slot);
+}
+
+/* SHOW ALL's display options: SORT BY, DESC, LIMIT/OFFSET, TOP */
+typedef struct {
+    int sort_by, desc;
+    long limit, offset;
+} ShowOpts;
+
+/* the word at *p is w (in any case): skips it and the spaces after it */
+static int opt_word(const char** p, const char* w) {
+    size_t n = strlen(w);
+    if (strncasecmp(*p, w, n) != 0 || ((*p)[n] && !isspace((unsigned char)(*p)[n]))) return 0;
+    lex_word(p);
+    return 1;
+}
+
+/* the count word at *p (skipped with the spaces after it); -1 when it is not a non-negative number */
+static long opt_count(const char** p) {
+    const char* s = *p;
+    char* end;
+    if (!isdigit((unsigned char)*s)) return -1;
+    long v = strtol(s, &end, 10);
+    if (*end && !isspace((unsigned char)*end)) return -1;
+    *p = end;
+    while (isspace((unsigned char)**p)) (*p)++;
+    return v > INT_MAX ? INT_MAX : v;
+}
+
+/* [SORT BY ID|MARK|PROGRAMME|NAME [ASC|DESC]] [LIMIT n [OFFSET m] | TOP n], word by word;
+   anything else prints the usage and returns 0 */
+static int parse_show_opts(const char* args, ShowOpts* o) {
+    static const char* const keys[SORT_KEYS] = { [SORT_ID] = "ID", [SORT_MARK] = "MARK",
+                                                 [SORT_PROGRAMME] = "PROGRAMME", [SORT_NAME] = "NAME" };
+    o->sort_by = -1; o->desc = 0; o->limit = -1; o->offset = 0;
+    long top = -1;
+    const char* p = args ? args : "";
+    while (isspace((unsigned char)*p)) p++;
+    while (*p) {
+        const char* at = p;
+        long* count = NULL;
+        if (opt_word(&p, "SORT")) {
+            int k = SORT_KEYS;
+            if (opt_word(&p, "BY")) for (k=0; k<SORT_KEYS && !opt_word(&p, keys[k]); ++k) {}
+            if (k == SORT_KEYS) p = at;
+            else o->sort_by = k;
+        }
+        else if (opt_word(&p, "ASC")) o->desc = 0;
+        else if (opt_word(&p, "DESC")) o->desc = 1;
+        else if (opt_word(&p, "LIMIT")) count = &o->limit;
+        else if (opt_word(&p, "OFFSET")) count = &o->offset;
+        else if (opt_word(&p, "TOP")) count = &top;
+        if (count && (*count = opt_count(&p)) < 0) {
+            out_printf("CMS: LIMIT, OFFSET and TOP take a non-negative number. e.g., SHOW ALL SORT BY MARK DESC LIMIT 20 OFFSET 40\n");
+            return 0;
+        }
+        if (p == at) {
+            out_printf("CMS: Cannot read the options at \"%.30s\". Usage → [SORT BY ID|MARK|PROGRAMME|NAME [ASC|DESC]] [LIMIT n [OFFSET m] | TOP n]\n", at);
+            return 0;
+        }
+    }
+    if (top >= 0) {
+        /* TOP n: the first n rows; on its own it means the n highest marks */
+        o->limit = top; o->offset = 0;
+        if (o->sort_by < 0) { o->sort_by = SORT_MARK; o->desc = 1; }
+    }
+    return 1;
+}
+
+/* ---- WHERE filters ----
+ * A predicate such as  Mark>=70 AND Programme="Nursing" AND ID BETWEEN 2300000 AND 2399999
+ * is compiled once into an ID interval, a mark interval and a per-programme
+ * flag table, so testing a record is two range checks and a byte lookup. */
+typedef struct {
+    int id_lo, id_hi;
+    float mark_lo, mark_hi;
+    unsigned char* prog_ok;   /* by programme ID; NULL = any programme */
+    int none;                 /* the conditions contradict each other */
+} Filter;
+
+static void filter_free(Filter* f) { free(f->prog_ok); f->prog_ok = NULL; }
+
+/* the float next to x towards +inf (up) or -inf, so strict bounds become inclusive */
+static float float_step(float x, int up) {
+    union { float f; uint32_t u; } v;
+    v.f = x;
+    if (x == 0.0f) { v.u = 1; return up ? v.f : -v.f; }
+    if ((x > 0.0f) == (up != 0)) v.u++; else v.u--;
+    return v.f;
+}
+
+static const char* skip_space(const char* s) {
+    while (isspace((unsigned char)*s)) s++;
+    return s;
+}
+
+/* reads an ID or mark literal; 0 if there is none */
+static int filter_number(const char** s, int is_id, double* out) {
+    const char* p = skip_space(*s);
+    char* end;
+    if (is_id) {
+        if (!isdigit((unsigned char)*p)) return 0;
+        long v = strtol(p, &end, 10);
+        *out = v > 100000000L ? 100000000.0 : (double)v;   /* beyond any 7-digit ID */
+    } else {
+        *out = strtod(p, &end);
+        if (end == p || *out != *out) return 0;
+    }
+    *s = end;
+    return 1;
+}
+
+/* narrows the interval for one comparison; op is one of = < <= > >= */
+static void filter_bound_id(Filter* f, const char* op, long v) {
+    if (v > INT_MAX-1) v = INT_MAX-1;
+    if (v < INT_MIN+1) v = INT_MIN+1;
+    int lo = (int)v, hi = (int)v;
+    if (op[0] == '<') { lo = INT_MIN; if (!op[1]) hi--; }
+    else if (op[0] == '>') { hi = INT_MAX; if (!op[1]) lo++; }
+    if (lo > f->id_lo) f->id_lo = lo;
+    if (hi < f->id_hi) f->id_hi = hi;
+}
+
+static void filter_bound_mark(Filter* f, const char* op, double d) {
+    float v = d > FLT_MAX ? FLT_MAX : d < -FLT_MAX ? -FLT_MAX : (float)d;
+    float lo = v, hi = v;
+    if (op[0] == '<') { lo = -FLT_MAX; if (!op[1]) hi = float_step(v, 0); }
+    else if (op[0] == '>') { hi = FLT_MAX; if (!op[1]) lo = float_step(v, 1); }
+    if (lo > f->mark_lo) f->mark_lo = lo;
+    if (hi < f->mark_hi) f->mark_hi = hi;
+}
+
+/* Compiles the predicate at s into f. Returns where the predicate ends (the
+   display options start there), or NULL with *bad at the text it could not read. */
+static const char* filter_compile(const char* s, Filter* f, const char** bad) {
+    f->id_lo = INT_MIN; f->id_hi = INT_MAX;
+    f->mark_lo = -FLT_MAX; f->mark_hi = FLT_MAX;
+    f->prog_ok = NULL; f->none = 0;
+    const char* p = skip_space(s);
+    for (;;) {
+        *bad = p;
+        const char* w = p;
+        while (isalpha((unsigned char)*w)) w++;
+        Keyword field = keyword_of(p, (size_t)(w-p));
+        if (field != KW_ID && field != KW_MARK && field != KW_PROGRAMME) return NULL;
+        p = skip_space(w);
+        char op[3] = "";
+        const char* q = p;
+        if (field != KW_PROGRAMME && lex_word(&q) == KW_BETWEEN && q != p) {
+            double lo, hi;
+            p = q;
+            if (!filter_number(&p, field == KW_ID, &lo)) return NULL;
+            q = skip_space(p);
+            if (lex_word(&q) != KW_AND || q == skip_space(p)) return NULL;
+            p = q;
+            if (!filter_number(&p, field == KW_ID, &hi)) return NULL;
+            if (field == KW_ID) { filter_bound_id(f, ">=", (long)lo); filter_bound_id(f, "<=", (long)hi); }
+            else { filter_bound_mark(f, ">=", lo); filter_bound_mark(f, "<=", hi); }
+        } else {
+            if (*p == '<' || *p == '>' || *p == '!' || *p == '=') {
+                op[0] = *p++;
+                if (*p == '=' || (op[0] == '<' && *p == '>')) op[1] = *p++;
+            }
+            if (!strcmp(op, "==")) op[1] = 0;
+            if (!strcmp(op, "<>")) strcpy(op, "!=");
+            if (!op[0] || !strcmp(op, "!")) return NULL;
+            if (field == KW_PROGRAMME) {
+                if (strcmp(op, "=") != 0 && strcmp(op, "!=") != 0) return NULL;
+                char name[MAX_PROG];
+                p = skip_space(p);
+                const char* from = p;
+                if (*p == '"') {
+                    const char* end = strchr(++from, '"');
+                    if (!end) return NULL;
+                    p = end+1;
+                    snprintf(name, sizeof(name), "%.*s", (int)(end-from), from);
+                } else {
+                    while (*p && !isspace((unsigned char)*p)) p++;
+                    if (p == from) return NULL;
+                    snprintf(name, sizeof(name), "%.*s", (int)(p-from), from);
+                }
+                normalise_caps(name);
+                int prog = prog_lookup(name);
+                if (!f->prog_ok) {
+                    f->prog_ok = (unsigned char*)malloc((size_t)n_progs+1);
+                    if (!f->prog_ok) { *bad = NULL; return NULL; }
+                    memset(f->prog_ok, 1, (size_t)n_progs+1);
+                }
+                if (op[0] == '=') {
+                    for (int k=0;k<n_progs;++k) if (k != prog) f->prog_ok[k] = 0;
+                } else if (prog >= 0) {
+                    f->prog_ok[prog] = 0;
+                }
+            } else {
+                double v;
+                if (op[0] == '!') return NULL;
+                if (!filter_number(&p, field == KW_ID, &v)) return NULL;
+                if (field == KW_ID) filter_bound_id(f, op, (long)v);
+                else filter_bound_mark(f, op, v);
+            }
+        }
+        if (*p && !isspace((unsigned char)*p)) return NULL;
+        p = skip_space(p);
+        q = p;
+        if (lex_word(&q) != KW_AND || q == p) break;
+        p = q;
+    }
+    *bad = p;
+    if (*p && !lex_export_opts(p)) return NULL;   /* OR, a typo, ...: not a filter this can run */
+    if (f->id_lo > f->id_hi || f->mark_lo > f->mark_hi) f->none = 1;
+    if (f->prog_ok) {
+        int any = 0;
+        for (int k=0;k<n_progs && !any;++k) any = f->prog_ok[k];
+        if (!any) f->none = 1;
+    }
+    return p;
+}
+
+static int filter_match(const Filter* f, int i) {
+    return col_id[i] >= f->id_lo && col_id[i] <= f->id_hi &&
+           col_mark[i] >= f->mark_lo && col_mark[i] <= f->mark_hi &&
+           (!f->prog_ok || f->prog_ok[col_prog[i]]);
+}
+
+/* appends the matching slots of [from, to) to hits; the ID and mark tests run four records at a time */
+static int filter_scan(const void* ctx, int from, int to, int* hits) {
+    const Filter* f = (const Filter*)ctx;
+    int nh = 0, i = from;
+#ifdef CMS_SSE2
+    const __m128i ilo = _mm_set1_epi32(f->id_lo), ihi = _mm_set1_epi32(f->id_hi);
+    const __m128 mlo = _mm_set1_ps(f->mark_lo), mhi = _mm_set1_ps(f->mark_hi);
+    for (; i+4 <= to; i += 4) {
+        __m128i id = _mm_loadu_si128((const __m128i*)(col_id+i));
+        __m128 out = _mm_castsi128_ps(_mm_or_si128(_mm_cmplt_epi32(id, ilo), _mm_cmpgt_epi32(id, ihi)));
+        __m128 m = _mm_loadu_ps(col_mark+i);
+        __m128 in = _mm_and_ps(_mm_cmpge_ps(m, mlo), _mm_cmple_ps(m, mhi));
+        int bits = _mm_movemask_ps(_mm_andnot_ps(out, in));
+        for (; bits; bits &= bits-1) {
+            int slot = i + (bits & 1 ? 0 : bits & 2 ? 1 : bits & 4 ? 2 : 3);
+            if (!f->prog_ok || f->prog_ok[col_prog[slot]]) hits[nh++] = slot;
+        }
+    }
+#endif
+    for (; i<to; ++i) if (filter_match(f, i)) hits[nh++] = i;
+    return nh;
+}
+
+/* first rank in an ID or mark order past the keys below the filter's interval (or, upper, inside it) */
+static int filter_order_bound(const Filter* f, SortKey k, const int* pos, int upper) {
+    int a = 0, b = n_records;
+    while (a < b) {
+        int mid = a + (b-a)/2, slot = pos[mid];
+        int before = k == SORT_ID ? (upper ? col_id[slot] <= f->id_hi : col_id[slot] < f->id_lo)
+                                  : (upper ? col_mark[slot] <= f->mark_hi : col_mark[slot] < f->mark_lo);
+        if (before) a = mid+1; else b = mid;
+    }
+    return a;
+}
+
+/* Matching slots in display (slot) order; NULL when out of memory. A single
+   ID goes through the ID index; an ID or mark range that an existing sort
+   order narrows to under a quarter of the table is read from that order;
+   anything else is one vector scan, split across the worker pool. */
+static int* filter_run(const Filter* f, int* n_hits) {
+    int* hits = (int*)malloc(sizeof(int)*(size_t)(n_records ? n_records : 1));
+    *n_hits = 0;
+    if (!hits || f->none) return hits;
+    if (f->id_lo == f->id_hi) {
+        int slot = find_index_by_id(f->id_lo);
+        if (slot >= 0 && filter_match(f, slot)) hits[(*n_hits)++] = slot;
+        return hits;
+    }
+    int best_lo = 0, best_hi = n_records, nh = 0, used = 0;
+    cms_mutex_lock(&index_lock);
+    for (int k=SORT_ID; k<=SORT_MARK; ++k) {
+        if (!sort_orders[k].valid) continue;
+        int lo = filter_order_bound(f, (SortKey)k, sort_orders[k].pos, 0);
+        int hi = filter_order_bound(f, (SortKey)k, sort_orders[k].pos, 1);
+        if (hi-lo < best_hi-best_lo) {
+            best_lo = lo; best_hi = hi; used = 1;
+            for (int r=lo; r<hi; ++r) hits[r-lo] = sort_orders[k].pos[r];
+        }
+    }
+    cms_mutex_unlock(&index_lock);
+    if (used && (best_hi-best_lo)*4 < n_records) {
+        for (int r=0; r<best_hi-best_lo; ++r) if (filter_match(f, hits[r])) hits[nh++] = hits[r];
+        qsort(hits, (size_t)nh, sizeof(int), cmp_int_asc);
+    } else {
+        nh = scan_slots(n_records, filter_scan, f, hits);
+    }
+    *n_hits = nh;
+    return hits;
+}
+
+typedef struct {
+    const unsigned char* picked;
+    int skip, left;
+    SlotVisitor visit;
+    void* ctx;
+} PickedWalk;
+
+static void visit_picked(int slot, void* ctx) {
+    PickedWalk* w = (PickedWalk*)ctx;
+    if (!w->picked[slot] || w->left <= 0) return;
+    if (w->skip > 0) { w->skip--; return; }
+    w->left--;
+    w->visit(slot, w->ctx);
+}
+
+/* visits rows first..first+count of the slots in hits (slot order), re-sorted by o; 0 when out of memory */
+static int rows_walk(const int* hits, int nh, const ShowOpts* o, int first, int count,
+                     SlotVisitor visit, void* ctx) {
+    if (o->sort_by < 0) {
+        for (int r=first; r<first+count; ++r) visit(hits[r], ctx);
+        return 1;
+    }
+    const int* order = sort_order_get((SortKey)o->sort_by);
+    unsigned char* picked = (unsigned char*)calloc((size_t)(n_records ? n_records : 1), 1);
+    if (!order || !picked) { free(picked); return 0; }
+    for (int r=0; r<nh; ++r) picked[hits[r]] = 1;
+    PickedWalk w = { picked, first, count, visit, ctx };
+    sort_order_walk((SortKey)o->sort_by, order, o->desc, 0, n_records, visit_picked, &w);
+    free(picked);
+    return 1;
+}
+
+static void filter_error(const char* bad) {
+    if (!bad) { out_printf("CMS: Memory error.\n"); return; }
+    out_printf("CMS: Cannot read the WHERE clause at \"%.30s\". e.g., SHOW WHERE Mark>=70 AND Programme=\"Computer Science\" AND ID BETWEEN 2300000 AND 2399999\n", bad);
+}
+
+/* rows [*first, *first + *count) of n after OFFSET/LIMIT */
+static void show_range(const ShowOpts* o, int n, int* first, int* count) {
+    *first = o->offset < n ? (int)o->offset : n;
+    *count = n - *first;
+    if (o->limit >= 0 && o->limit < *count) *count = (int)o->limit;
+}
+
+static void cmd_show_where(const Command* cmd) {
+    Filter f;
+    const char* bad;
+    const char* rest = filter_compile(cmd->where, &f, &bad);
+    if (!rest) { filter_free(&f); filter_error(bad); return; }
+    ShowOpts o;
+    if (!parse_show_opts(rest, &o)) { filter_free(&f); return; }
+    int nh;
+    int* hits = filter_run(&f, &nh);
+    filter_free(&f);
+    if (!hits) { out_printf("CMS: Memory error.\n"); return; }
+    int first, count;
+    show_range(&o, nh, &first, &count);
+    out_printf("CMS: %d of %d records in the table \"StudentRecords\" match.\n", nh, n_records);
+    if (o.limit >= 0 || o.offset > 0) {
+        if (count > 0) out_printf("CMS: Showing records %d-%d.\n", first+1, first+count);
+        else out_printf("CMS: No records in the requested range.\n");
+    }
+    print_record_header();
+    if (!rows_walk(hits, nh, &o, first, count, visit_print, NULL)) out_printf("CMS: Memory error.\n");
+    out_flush(session->rows);
+    free(hits);
+}
+
+static void cmd_show_all(const Command* cmd) {
+    if (cmd->where) { cmd_show_where(cmd); return; }
+    ShowOpts o;
+    if (!parse_show_opts(cmd->args, &o)) return;
+    const int* order = NULL;
+    if (o.sort_by >= 0 && !(order = sort_order_get((SortKey)o.sort_by))) { out_printf("CMS: Memory error.\n"); return; }
+
+    int first, count;
+    show_range(&o, n_records, &first, &count);
+
+    out_printf("CMS: Here are all the records found in the table \"StudentRecords\" (%d total).\n", n_records);
+    if (o.limit >= 0 || o.offset > 0) {
+        if (count > 0) out_printf("CMS: Showing records %d-%d.\n", first+1, first+count);
+        else out_printf("CMS: No records in the requested range.\n");
+    }
+    print_record_header();
+    if (order) sort_order_walk((SortKey)o.sort_by, order, o.desc, first, count, visit_print, NULL);
+    else for (int i=first;i<first+count;++i) print_record(i);
+    out_flush(session->rows);
+}
+
+/* ---- EXPORT formats ----
+ * Each format is a header and a row formatter: CSV and TSV with a header
+ * line, JSON Lines with one object per record, and BIN as a binary
+ * snapshot (BinHeader and BinRecords) that OPEN reads back. */
+#define EXPORT_ROW_MAX (OUT_ROW_MAX + 12*MAX_NAME)   /* a JSON row with every name byte escaped */
+
+/* "%07d,\"%s\",\"%s\",%.2f\n" */
+static char* fmt_csv_row(char* p, int slot) {
+    p = fmt_int(p, col_id[slot], 7); *p++ = ','; *p++ = '"';
+    p = fmt_str(p, rec_name(slot), 0, -1); *p++ = '"'; *p++ = ','; *p++ = '"';
+    p = fmt_str(p, rec_prog(slot), 0, -1); *p++ = '"'; *p++ = ',';
+    p = fmt_mark(p, col_mark[slot], 0); *p++ = '\n';
+    return p;
+}
+
+/* a TSV field: tabs and line breaks would split it, so they become spaces */
+static char* fmt_tsv_str(char* p, const char* s) {
+    for (; *s; ++s) *p++ = (*s == '\t' || *s == '\n' || *s == '\r') ? ' ' : *s;
+    return p;
+}
+
+/* "%07d\t%s\t%s\t%.2f\n" */
+static char* fmt_tsv_row(char* p, int slot) {
+    p = fmt_int(p, col_id[slot], 7); *p++ = '\t';
+    p = fmt_tsv_str(p, rec_name(slot)); *p++ = '\t';
+    p = fmt_tsv_str(p, rec_prog(slot)); *p++ = '\t';
+    p = fmt_mark(p, col_mark[slot], 0); *p++ = '\n';
+    return p;
+}
+
+/* a JSON string body: quote, backslash and control characters escaped */
+static char* fmt_json_str(char* p, const char* s) {
+    static const char hex[] = "0123456789abcdef";
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') { *p++ = '\\'; *p++ = (char)c; }
+        else if (c < 0x20) { memcpy(p, "\\u00", 4); p[4] = hex[c >> 4]; p[5] = hex[c & 15]; p += 6; }
+        else *p++ = (char)c;
+    }
+    return p;
+}
+
+/* {"id":2301234,"name":"...","programme":"...","mark":70.50} */
+static char* fmt_jsonl_row(char* p, int slot) {
+    float m = col_mark[slot];
+    memcpy(p, "{\"id\":", 6); p = fmt_int(p + 6, col_id[slot], 0);
+    memcpy(p, ",\"name\":\"", 9); p = fmt_json_str(p + 9, rec_name(slot));
+    memcpy(p, "\",\"programme\":\"", 15); p = fmt_json_str(p + 15, rec_prog(slot));
+    memcpy(p, "\",\"mark\":", 9); p += 9;
+    if (m - m == 0.0f) p = fmt_mark(p, m, 0);
+    else { memcpy(p, "null", 4); p += 4; }   /* JSON has no inf or nan */
+    *p++ = '}'; *p++ = '\n';
+    return p;
+}
+
+static char* fmt_bin_row(char* p, int slot) {
+    BinRecord r;
+    memset(&r, 0, sizeof(r));
+    r.id = col_id[slot];
+    strncpy(r.name, rec_name(slot), MAX_NAME-1);
+    strncpy(r.programme, rec_prog(slot), MAX_PROG-1);
+    r.mark = col_mark[slot];
+    memcpy(p, &r, sizeof(r));
+    return p + sizeof(r);
 }
 
-static void push_undo(UndoEntry e) {
-    if (undo_top < (int)(sizeof(undo_stack)/sizeof(undo_stack[0]))) {
-        undo_stack[undo_top++] = e;
-    } else {
-        memmove(undo_stack, undo_stack+1, (undo_top-1)*sizeof(UndoEntry));
-        undo_stack[undo_top-1] = e;
-    }
+typedef char* (*RowFormatter)(char* p, int slot);
+
+typedef enum { EXP_CSV, EXP_JSONL, EXP_TSV, EXP_BIN, EXP_FORMATS } ExportFormat;
+
+static const struct {
+    int key;              /* EXPORT <key>="file" */
+    const char* name;
+    const char* header;   /* text formats' first line */
+    RowFormatter row;
+} export_formats[EXP_FORMATS] = {
+    [EXP_CSV]   = { KEY_CSV,   "CSV",   "ID,Name,Programme,Mark\n",     fmt_csv_row },
+    [EXP_JSONL] = { KEY_JSONL, "JSONL", "",                             fmt_jsonl_row },
+    [EXP_TSV]   = { KEY_TSV,   "TSV",   "ID\tName\tProgramme\tMark\n",  fmt_tsv_row },
+    [EXP_BIN]   = { KEY_BIN,   "BIN",   NULL,                           fmt_bin_row },
+};
+
+static void visit_collect(int slot, void* ctx) {
+    int** at = (int**)ctx;
+    *(*at)++ = slot;
 }
 
-static void cmd_export_csv(const char* line) {
-    if (n_records == 0) {
-        printf("CMS: No records loaded. Nothing to export.\n");
-        return;
-    }
-    char filename[256];
-    if (!parse_between(line, "CSV", filename, sizeof(filename))) {
-        printf("CMS: Please specify CSV=\"<filename>\". e.g., EXPORT CSV=\"students.csv\"\n");
-        return;
-    }
-    FILE* fp = fopen(filename, "w");
-    if (!fp) {
-        printf("CMS: Failed to open CSV file '%s' for writing.\n", filename);
-        return;
-    }
-    fprintf(fp, "ID,Name,Programme,Mark\n");
-    for (int i = 0; i < n_records; ++i) {
-        fprintf(fp, "%07d,\"%s\",\"%s\",%.2f\n",
-                records[i].id,
-                records[i].name,
-                records[i].programme,
-                records[i].mark);
+/* EXPORT formats SCAN_CHUNK rows per pool task into the task's own buffer,
+   a couple of tasks per worker at a time, and writes the buffers in order */
+typedef struct {
+    char* buf;
+    size_t len, cap;
+    int failed;        /* out of memory */
+} TextRun;
+
+typedef struct {
+    RowFormatter row;
+    const int* rows;   /* the slots to write, or NULL for slots first.. in store order */
+    int first, count;
+    int base;          /* task number of runs[0] */
+    TextRun* runs;
+} ExportJob;
+
+static void export_task(void* ctx, int task) {
+    ExportJob* j = (ExportJob*)ctx;
+    TextRun* r = &j->runs[task];
+    int lo = (j->base+task)*SCAN_CHUNK, hi = lo+SCAN_CHUNK < j->count ? lo+SCAN_CHUNK : j->count;
+    r->len = 0;
+    for (int i=lo;i<hi;++i) {
+        if (r->cap - r->len < EXPORT_ROW_MAX) {
+            size_t cap = r->cap ? r->cap*2 : OUT_BUF_SIZE;
+            char* b = (char*)realloc(r->buf, cap);
+            if (!b) { r->failed = 1; return; }
+            r->buf = b; r->cap = cap;
+        }
+        r->len = (size_t)(j->row(r->buf + r->len, j->rows ? j->rows[i] : j->first + i) - r->buf);
     }
-    fclose(fp);
-    printf("CMS: Exported %d records to '%s'.\n", n_records, filename);
 }
 
-static void maybe_autosave(void) {
-    if (autosave_on && db_filename[0]) {
-        if (save_db(db_filename)) {
-            printf("CMS: Autosave complete → \"%s\".\n", db_filename);
-        } else {
-            printf("CMS: Autosave FAILED. Please SAVE manually and check permissions.\n");
+/* writes count rows; *sum (when given) is checksummed over the bytes written.
+   0 when out of memory or the write fails */
+static int export_write_rows(FILE* fp, RowFormatter row, const int* rows, int first, int count, uint64_t* sum) {
+    int tasks = (count + SCAN_CHUNK-1) / SCAN_CHUNK, batch = worker_count()*2;
+    if (batch > 2*POOL_MAX) batch = 2*POOL_MAX;
+    if (batch > tasks) batch = tasks;
+    if (batch < 1) return 1;
+    TextRun* runs = (TextRun*)calloc((size_t)batch, sizeof(TextRun));
+    int ok = runs != NULL;
+    ExportJob j = { row, rows, first, count, 0, runs };
+    for (; ok && j.base < tasks; j.base += batch) {
+        int nb = tasks - j.base < batch ? tasks - j.base : batch;
+        pool_run(nb, export_task, &j);
+        for (int k=0;k<nb && ok;++k) {
+            if (runs[k].failed) ok = 0;
+            else {
+                if (sum) *sum = checksum_update(*sum, runs[k].buf, runs[k].len);
+                ok = fwrite(runs[k].buf, 1, runs[k].len, fp) == runs[k].len;
+            }
         }
     }
+    for (int k=0;runs && k<batch;++k) free(runs[k].buf);
+    free(runs);
+    return ok;
 }
 
-static void print_record_header(void) {
-    /* Fixed-width columns so long names/programmes do not break alignment.
-       Names/programmes may be visually truncated in SHOW ALL but the full value
-       remains stored and is visible via QUERY. */
-    printf("%-7s  %-35s  %-25s  %-5s\n",
-           "ID", "Name", "Programme", "Mark");
+/* ---- Summaries ----
+ * Totals come from the running aggregates (or a double-precision scan when
+ * their fixed point cannot hold the marks); minimum, maximum, median and
+ * percentiles are read by rank off the MARK sort order. */
+
+/* square root by Newton's method (keeps the build free of libm) */
+static double agg_sqrt(double x) {
+    if (x != x || x > DBL_MAX) return x;   /* NaN or infinity: Newton would never settle */
+    if (x <= 0.0) return 0.0;
+    double r = x > 1.0 ? x : 1.0;
+    for (;;) {
+        double next = 0.5*(r + x/r);
+        if (next >= r) return r;
+        r = next;
+    }
 }
 
-static void print_record(const Student* s) {
-    printf("%07d  %-35.35s  %-25.25s  %5.2f\n",
-           s->id,
-           s->name,
-           s->programme,
-           s->mark);
+/* sum and sum of squares of the marks by programme, then overall, two doubles
+   each, by one scan in slot order (so independent of SET THREADS); NULL when
+   out of memory */
+static double* agg_scan_wide(void) {
+    double* w = (double*)calloc((size_t)(n_progs+1)*2, sizeof(double));
+    if (!w) return NULL;
+    double* all = w + 2*(size_t)n_progs;
+    for (int i=0;i<n_records;++i) {
+        double m = col_mark[i];
+        double* to = w + 2*(size_t)col_prog[i];
+        to[0] += m; to[1] += m*m;
+        all[0] += m; all[1] += m*m;
+    }
+    return w;
 }
 
+/* mean and population standard deviation of a programme's (or all) marks;
+   wide is its pair from agg_scan_wide when the fixed-point sums are not exact */
+static void agg_stats(const MarkAgg* a, const double* wide, double* mean, double* sd) {
+    *mean = *sd = 0.0;
+    if (a->count <= 0) return;
+    double sum = wide ? wide[0] : (double)(int64_t)a->sum / AGG_FX;
+    double sumsq = wide ? wide[1] : (double)(int64_t)a->sumsq / AGG_FX2;
+    *mean = sum / a->count;
+    *sd = agg_sqrt(sumsq / a->count - *mean * *mean);
+}
 
+/* the p-th quantile (0..1) of the marks, interpolating between neighbouring ranks */
+static double mark_quantile(const int* pos, int n, double p) {
+    double r = p * (n-1);
+    int k = (int)r;
+    if (k >= n-1) return col_mark[pos[n-1]];
+    return col_mark[pos[k]] + (r-k) * (col_mark[pos[k+1]] - col_mark[pos[k]]);
+}
 
-static void cmd_show_all(const char* args) {
-    Student* tmp = (Student*)malloc(sizeof(Student)*(size_t)n_records);
-    if (!tmp) { printf("CMS: Memory error.\n"); return; }
-    memcpy(tmp, records, sizeof(Student)*(size_t)n_records);
+/* the earliest slot among the equal marks at one end of the MARK order */
+static int mark_end_slot(const int* pos, int n, int top) {
+    int r = top ? n-1 : 0, step = top ? -1 : 1, best = pos[r];
+    for (int j=r+step; j>=0 && j<n && col_mark[pos[j]] == col_mark[pos[r]]; j+=step)
+        if (pos[j] < best) best = pos[j];
+    return best;
+}
 
-    int sort_by=0, desc=0;
-    if (args && *args) {
-        char up[MAX_LINE]; strncpy(up,args,sizeof(up)-1); up[sizeof(up)-1]=0;
-        strtoupper_inplace(up);
-        if (strstr(up,"SORT BY ID")) sort_by=1;
-        else if (strstr(up,"SORT BY MARK")) sort_by=2;
-        else if (strstr(up,"SORT BY PROGRAMME")) sort_by=3;
-        else if (strstr(up,"SORT BY NAME")) sort_by=4;
-        if (strstr(up,"DESC")) desc=1;
-        if (sort_by==1) qsort(tmp,(size_t)n_records,sizeof(Student), desc?cmp_id_desc:cmp_id_asc);
-        else if (sort_by==2) qsort(tmp,(size_t)n_records,sizeof(Student), desc?cmp_mark_desc:cmp_mark_asc);
-        else if (sort_by==3) qsort(tmp,(size_t)n_records,sizeof(Student), desc?cmp_programme_desc:cmp_programme_asc);
-        else if (sort_by==4) qsort(tmp,(size_t)n_records,sizeof(Student), desc?cmp_name_desc:cmp_name_asc);
+static void cmd_show_summary(void) {
+    if (n_records==0) { out_printf("CMS: No records loaded.\n"); return; }
+    const int* pos = sort_order_get(SORT_MARK);
+    double* wide = NULL;
+    if (!agg_refresh() || !pos || (!agg_exact() && !(wide = agg_scan_wide()))) {
+        out_printf("CMS: Memory error.\n");
+        return;
     }
-    printf("CMS: Here are all the records found in the table \"StudentRecords\" (%d total).\n", n_records);
-    print_record_header();
-    for (int i=0;i<n_records;++i) print_record(&tmp[i]);
-    free(tmp);
+    int total=agg_all.count;
+    int hi_idx = mark_end_slot(pos, total, 1);
+    int lo_idx = mark_end_slot(pos, total, 0);
+    int A=agg_band[0], B=agg_band[1]-agg_band[0], C=agg_band[2]-agg_band[1], D=agg_band[3]-agg_band[2], Fc=total-agg_band[3];
+    double avg, sd;
+    agg_stats(&agg_all, wide ? wide + 2*(size_t)n_progs : NULL, &avg, &sd);
+    free(wide);
+    out_printf("CMS: SUMMARY\n");
+    out_printf("Total students: %d\n", total);
+    out_printf("Average mark : %.2f\n", avg);
+    out_printf("Median mark  : %.2f\n", mark_quantile(pos, total, 0.5));
+    out_printf("Std deviation: %.2f\n", sd);
+    out_printf("Highest mark : %.2f (%s)\n", col_mark[hi_idx], rec_name(hi_idx));
+    out_printf("Lowest mark  : %.2f (%s)\n", col_mark[lo_idx], rec_name(lo_idx));
+    out_printf("Percentiles  : P10=%.2f  P25=%.2f  P75=%.2f  P90=%.2f\n",
+           mark_quantile(pos, total, 0.10), mark_quantile(pos, total, 0.25),
+           mark_quantile(pos, total, 0.75), mark_quantile(pos, total, 0.90));
+    out_printf("Grade bands  : A=%d  B=%d  C=%d  D=%d  F=%d\n", A,B,C,D,Fc);
 }
 
-static void cmd_show_summary(void) {
-    if (n_records==0) { printf("CMS: No records loaded.\n"); return; }
-    int total=n_records;
-    float sum=0.0f;
-    int hi_idx=0, lo_idx=0;
-    int A=0,B=0,C=0,D=0,Fc=0;
-    for (int i=0;i<n_records;++i) {
-        float m=records[i].mark;
-        sum += m;
-        if (m>records[hi_idx].mark) hi_idx=i;
-        if (m<records[lo_idx].mark) lo_idx=i;
-        if (m>=80) A++;
-        else if (m>=70) B++;
-        else if (m>=60) C++;
-        else if (m>=50) D++;
-        else Fc++;
-    }
-    float avg=sum/(float)total;
-    printf("CMS: SUMMARY\n");
-    printf("Total students: %d\n", total);
-    printf("Average mark : %.2f\n", avg);
-    printf("Highest mark : %.2f (%s)\n", records[hi_idx].mark, records[hi_idx].name);
-    printf("Lowest mark  : %.2f (%s)\n", records[lo_idx].mark, records[lo_idx].name);
-    printf("Grade bands  : A=%d  B=%d  C=%d  D=%d  F=%d\n", A,B,C,D,Fc);
-}
-
-static int parse_and_validate_id(const char* line, int* out_id);
-
-static void cmd_query(const char* line) {
+static int parse_and_validate_id(const Command* cmd, int* out_id);
+
+static void cmd_query(const Command* cmd) {
     int id;
-    int id_ok = parse_and_validate_id(line, &id);
+    int id_ok = parse_and_validate_id(cmd, &id);
     if (id_ok <= 0) {
-        printf("CMS: Please provide a valid 7-digit numeric ID. e.g., QUERY ID=2401234\n");
+        out_printf("CMS: Please provide a valid 7-digit numeric ID. e.g., QUERY ID=2401234\n");
         return;
     }
     int idx = find_index_by_id(id);
     if (idx<0) {
-        printf("CMS: The record with ID=%d does not exist.\n", id);
+        out_printf("CMS: The record with ID=%d does not exist.\n", id);
         return;
     }
-    printf("CMS: The record with ID=%d is found in the data table.\n", id);
+    out_printf("CMS: The record with ID=%d is found in the data table.\n", id);
     print_record_header();
-    print_record(&records[idx]);
+    print_record(idx);
+    out_flush(session->rows);
 }
 
 
-static int parse_and_validate_id(const char* line, int* out_id) {
-    char s_id[64];
-    if (!parse_between(line,"ID",s_id,sizeof(s_id))) return 0;
+/* ID rules shared by INSERT-style commands and IMPORT: 1 ok, -1 not 7 digits, -2 not positive */
+static int validate_id_text(const char* s_id, int* out_id) {
     size_t len = strlen(s_id);
     if (len != 7) return -1; // must be exactly 7 digits
     for (size_t i = 0; i < len; ++i) {
@@ -399,324 +4212,1170 @@ static int parse_and_validate_id(const char* line, int* out_id) {
     return 1;
 }
 
-static int parse_and_validate_mark(const char* line, float* out_mark) {
-    char s_mark[64];
-    if (!parse_between(line,"MARK",s_mark,sizeof(s_mark))) return 0;
+static int parse_and_validate_id(const Command* cmd, int* out_id) {
+    char s_id[64];
+    if (!cmd_value(cmd, KEY_ID, s_id,sizeof(s_id))) return 0;
+    return validate_id_text(s_id, out_id);
+}
+
+/* mark rules shared with IMPORT: 1 ok, -1 outside 0..100 */
+static int validate_mark_text(const char* s_mark, float* out_mark) {
     float m = (float)atof(s_mark);
     if (m<0.0f || m>100.0f) return -1;
     *out_mark = m; return 1;
 }
 
+static int parse_and_validate_mark(const Command* cmd, float* out_mark) {
+    char s_mark[64];
+    if (!cmd_value(cmd, KEY_MARK, s_mark,sizeof(s_mark))) return 0;
+    return validate_mark_text(s_mark, out_mark);
+}
+
+
+static int cmp_agg_first(const void* a, const void* b) {
+    int x = agg_prog[*(const int*)a].first, y = agg_prog[*(const int*)b].first;
+    return (x > y) - (x < y);
+}
 
 static void cmd_show_programme_summary(void) {
     if (n_records==0) {
-        printf("CMS: No records loaded.\n");
+        out_printf("CMS: No records loaded.\n");
         return;
     }
-    typedef struct {
-        char programme[MAX_PROG];
-        int count;
-        float total_mark;
-    } ProgrammeSummary;
+    int* rows = agg_refresh() ? (int*)malloc(sizeof(int)*(size_t)(agg_prog_cap ? agg_prog_cap : 1)) : NULL;
+    double* wide = NULL;
+    if (!rows || (!agg_exact() && !(wide = agg_scan_wide()))) {
+        out_printf("CMS: Memory error.\n");
+        free(rows);
+        return;
+    }
+    /* programmes with records, in first-seen record order */
+    int n_rows = 0;
+    for (int p=0; p<agg_prog_cap; ++p) if (agg_prog[p].count > 0) rows[n_rows++] = p;
+    qsort(rows, (size_t)n_rows, sizeof(int), cmp_agg_first);
+
+    out_printf("CMS: Programme summary (per programme):\n");
+    out_printf("%-30s %-10s %-10s %-10s %-10s %-10s\n", "Programme", "Count", "AvgMark", "StdDev", "Min", "Max");
+    out_printf("--------------------------------------------------------------------------------------\n");
+    for (int i=0; i<n_rows; ++i) {
+        const MarkAgg* a = &agg_prog[rows[i]];
+        double avg, sd;
+        agg_stats(a, wide ? wide + 2*(size_t)rows[i] : NULL, &avg, &sd);
+        out_printf("%-30s %-10d %-10.2f %-10.2f %-10.2f %-10.2f\n", prog_str[rows[i]], a->count, avg,
+               sd, a->lo, a->hi);
+    }
+    free(rows);
+    free(wide);
+}
 
-    ProgrammeSummary ps[256];
-    int n_prog = 0;
+/* build the trigram indexes on first use; 0 when out of memory (callers scan instead) */
+static int name_tri_build(void) {
+    if (name_tri.valid) return 1;
+    for (int i=0;i<n_records;++i) {
+        if (!tri_add(&name_tri, rec_name(i), col_id[i])) { tri_clear(&name_tri); return 0; }
+    }
+    name_tri.valid = 1;
+    return 1;
+}
 
-    for (int i=0; i<n_records; ++i) {
-        int idx = -1;
-        for (int j=0; j<n_prog; ++j) {
-            if (strcmp(ps[j].programme, records[i].programme) == 0) {
-                idx = j;
-                break;
-            }
-        }
-        if (idx == -1) {
-            if (n_prog >= (int)(sizeof(ps)/sizeof(ps[0]))) {
-                continue; /* safety guard, should not happen for typical datasets */
-            }
-            idx = n_prog++;
-            strncpy(ps[idx].programme, records[i].programme, MAX_PROG-1);
-            ps[idx].programme[MAX_PROG-1] = '\0';
-            ps[idx].count = 0;
-            ps[idx].total_mark = 0.0f;
-        }
-        ps[idx].count += 1;
-        ps[idx].total_mark += records[i].mark;
+static int prog_tri_build(void) {
+    if (prog_tri.valid) return 1;
+    for (int p=0;p<n_progs;++p) {
+        if (!tri_add(&prog_tri, prog_str[p], p)) { tri_clear(&prog_tri); return 0; }
     }
+    prog_tri.valid = 1;
+    return 1;
+}
+
+static int name_tri_ready(void) {
+    cms_mutex_lock(&index_lock);
+    int ok = name_tri_build();
+    cms_mutex_unlock(&index_lock);
+    return ok;
+}
+
+static int prog_tri_ready(void) {
+    cms_mutex_lock(&index_lock);
+    int ok = prog_tri_build();
+    cms_mutex_unlock(&index_lock);
+    return ok;
+}
 
-    printf("CMS: Programme summary (per programme):\n");
-    printf("%-30s %-10s %-10s\n", "Programme", "Count", "AvgMark");
-    printf("--------------------------------------------------------------\n");
-    for (int i=0; i<n_prog; ++i) {
-        float avg = ps[i].total_mark / (float)ps[i].count;
-        printf("%-30s %-10d %-10.2f\n", ps[i].programme, ps[i].count, avg);
+/* flags[p] = 1 for every interned programme that satisfies the test; caller frees */
+static unsigned char* match_programmes(const char* key, int substring) {
+    unsigned char* flags = (unsigned char*)calloc((size_t)(n_progs ? n_progs : 1), 1);
+    if (!flags) return NULL;
+    char key_lc[MAX_PROG]; strncpy(key_lc, key, sizeof(key_lc)-1); key_lc[sizeof(key_lc)-1] = '\0';
+    for (char* c = key_lc; *c; ++c) *c = (char)tolower((unsigned char)*c);
+    size_t n = strlen(key_lc);
+    const int* cand; int nc;
+    if (substring && prog_tri_ready() && (nc = tri_candidates(&prog_tri, key_lc, &cand)) >= 0) {
+        for (int j=0;j<nc;++j) flags[cand[j]] = (unsigned char)fold_contains(prog_fold[cand[j]], key_lc, n);
+        return flags;
     }
+    for (int p=0; p<n_progs; ++p) {
+        flags[p] = (unsigned char)(substring ? fold_contains(prog_fold[p], key_lc, n) : strcmp(prog_fold[p], key_lc) == 0);
+    }
+    return flags;
+}
+
+typedef struct {
+    const char* key;   /* folded */
+    size_t n;
+} FoldKey;
+
+/* chunk scans for FIND and SHOW PROGRAMME: names containing a folded key, records in flagged programmes */
+static int name_scan(const void* ctx, int lo, int hi, int* out) {
+    const FoldKey* k = (const FoldKey*)ctx;
+    int n = 0;
+    for (int i=lo;i<hi;++i) if (fold_contains(rec_fold(i), k->key, k->n)) out[n++] = i;
+    return n;
+}
+
+static int prog_scan(const void* ctx, int lo, int hi, int* out) {
+    const unsigned char* match = (const unsigned char*)ctx;
+    int n = 0;
+    for (int i=lo;i<hi;++i) if (match[col_prog[i]]) out[n++] = i;
+    return n;
+}
+
+/* prints the records a scan picks, in store order; the count, or -1 when out of memory */
+static int print_scan(chunk_scan scan, const void* ctx) {
+    int* hits = (int*)malloc(sizeof(int)*(size_t)(n_records ? n_records : 1));
+    if (!hits) return -1;
+    int nh = scan_slots(n_records, scan, ctx, hits);
+    for (int j=0;j<nh;++j) print_record(hits[j]);
+    free(hits);
+    return nh;
 }
 
-static void cmd_show_programme_exact(const char* line) {
+static void cmd_show_programme_exact(const Command* cmd) {
     if (n_records==0) {
-        printf("CMS: No records loaded.\n");
+        out_printf("CMS: No records loaded.\n");
         return;
     }
     char prog[MAX_PROG];
-    if (!parse_between(line, "PROGRAMME", prog, sizeof(prog))) {
-        printf("CMS: Please specify PROGRAMME=\"<programme name>\". e.g., SHOW PROGRAMME PROGRAMME=\"Applied AI\"\n");
+    if (!cmd_value(cmd, KEY_PROGRAMME, prog, sizeof(prog))) {
+        out_printf("CMS: Please specify PROGRAMME=\"<programme name>\". e.g., SHOW PROGRAMME PROGRAMME=\"Applied AI\"\n");
         return;
     }
-    char key_lc[MAX_PROG]; strncpy(key_lc, prog, sizeof(key_lc)-1); key_lc[sizeof(key_lc)-1] = '\0';
-    for (char* p = key_lc; *p; ++p) *p = (char)tolower((unsigned char)*p);
+    unsigned char* match = match_programmes(prog, 0);
+    if (!match) { out_printf("CMS: Memory error.\n"); return; }
 
-    int found = 0;
-    printf("CMS: Students in programme matching \"%s\":\n", prog);
+    out_printf("CMS: Students in programme matching \"%s\":\n", prog);
     print_record_header();
-    for (int i = 0; i < n_records; ++i) {
-        char prog_lc[MAX_PROG]; strncpy(prog_lc, records[i].programme, sizeof(prog_lc)-1); prog_lc[sizeof(prog_lc)-1] = '\0';
-        for (char* p = prog_lc; *p; ++p) *p = (char)tolower((unsigned char)*p);
-        if (strcmp(prog_lc, key_lc) == 0) {
-            print_record(&records[i]);
-            found = 1;
-        }
-    }
-    if (!found) printf("(no exact programme matches)\n");
+    int found = print_scan(prog_scan, match);
+    out_flush(session->rows);
+    free(match);
+    if (found < 0) out_printf("CMS: Memory error.\n");
+    else if (!found) out_printf("(no exact programme matches)\n");
 }
 
 
 
-static void cmd_insert(const char* line) {
-    int id; int id_ok = parse_and_validate_id(line,&id);
-    if (id_ok<=0) { printf("CMS: Please provide a valid 7-digit numeric ID.\n"); return; }
-    if (find_index_by_id(id)>=0) { printf("CMS: The record with ID=%d already exists.\n", id); return; }
+static void cmd_insert(const Command* cmd) {
+    int id; int id_ok = parse_and_validate_id(cmd, &id);
+    if (id_ok<=0) { out_printf("CMS: Please provide a valid 7-digit numeric ID.\n"); return; }
+    if (find_index_by_id(id)>=0) { out_printf("CMS: The record with ID=%d already exists.\n", id); return; }
 
     char s_name[MAX_NAME], s_prog[MAX_PROG];
-    float mark; int has_mark = parse_and_validate_mark(line,&mark);
-    if (!parse_between(line,"NAME",s_name,sizeof(s_name)) ||
-        !parse_between(line,"PROGRAMME",s_prog,sizeof(s_prog)) ||
+    float mark; int has_mark = parse_and_validate_mark(cmd, &mark);
+    if (!cmd_value(cmd, KEY_NAME, s_name,sizeof(s_name)) ||
+        !cmd_value(cmd, KEY_PROGRAMME, s_prog,sizeof(s_prog)) ||
         has_mark<=0) {
-        printf("CMS: Missing or invalid fields. Required: NAME, PROGRAMME, MARK (0..100).\n");
+        out_printf("CMS: Missing or invalid fields. Required: NAME, PROGRAMME, MARK (0..100).\n");
         return;
     }
-    if (n_records>=MAX_RECORDS) { printf("CMS: Cannot insert, reached max records.\n"); return; }
+    if (!records_reserve(n_records+1)) { out_printf("CMS: Cannot insert, out of memory.\n"); return; }
     normalise_caps(s_name);
     normalise_caps(s_prog);
     Student s; s.id=id;
     strncpy(s.name,s_name,MAX_NAME-1); s.name[MAX_NAME-1]=0;
     strncpy(s.programme,s_prog,MAX_PROG-1); s.programme[MAX_PROG-1]=0;
     s.mark=mark;
-    records[n_records++]=s;
-    printf("CMS: A new record with ID=%d is successfully inserted.\n", id);
+    if (store_append(&s) < 0) { out_printf("CMS: Cannot insert, out of memory.\n"); return; }
+    out_printf("CMS: A new record with ID=%d is successfully inserted.\n", id);
+    journal_put(&s);
+
+    push_undo(undo_record(OP_INSERT, &s));
+    maybe_autosave();
+}
+
+/* split one CSV line in place: fields may be quoted ("" is a literal quote);
+   returns the number of fields, or -1 on an unterminated quote */
+static int csv_split(char* line, char** fields, int max) {
+    int n = 0;
+    char* p = line;
+    for (;;) {
+        while (*p==' ' || *p=='\t') p++;
+        char* out = p;
+        char* start = p;
+        if (*p == '"') {
+            start = out = ++p;
+            for (;;) {
+                if (!*p) return -1;
+                if (*p == '"') {
+                    if (p[1] != '"') { p++; break; }
+                    p++;
+                }
+                *out++ = *p++;
+            }
+            while (*p && *p != ',') p++;
+        } else {
+            while (*p && *p != ',') p++;
+            out = p;
+            while (out > start && isspace((unsigned char)out[-1])) out--;
+        }
+        char sep = *p;
+        *out = '\0';
+        if (n < max) fields[n] = start;
+        n++;
+        if (sep != ',') break;
+        p++;
+    }
+    return n;
+}
+
+#define IMPORT_REPORT_MAX 20
+
+static void import_reject(int* rejected, int line_no, const char* why) {
+    if (++*rejected <= IMPORT_REPORT_MAX) out_printf("CMS:   line %d rejected: %s\n", line_no, why);
+}
+
+/* IMPORT CSV="file": the inverse of EXPORT CSV. Rows are validated like
+   INSERT and appended in bulk; sort orders and the name index are dropped
+   once and rebuilt on next use, and autosave writes one snapshot. */
+static void cmd_import_csv(const Command* cmd) {
+    char filename[256];
+    if (!cmd_value(cmd, KEY_CSV, filename, sizeof(filename))) {
+        out_printf("CMS: Please specify CSV=\"<filename>\". e.g., IMPORT CSV=\"students.csv\"\n");
+        return;
+    }
+    FILE* fp = fopen(filename, "r");
+    if (!fp) {
+        out_printf("CMS: Failed to open CSV file '%s' for reading.\n", filename);
+        return;
+    }
+    /* size the columns and ID index once from a rough row estimate */
+    fseek(fp, 0, SEEK_END);
+    long bytes = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    long guess = bytes > 0 ? bytes / 40 : 0;
+    if (guess > INT_MAX - n_records) guess = INT_MAX - n_records;
+    records_reserve(n_records + (int)guess);
+    id_index_reserve(n_records + (int)guess);
+    sort_orders_invalidate();
+    tri_clear(&name_tri);
 
-    UndoEntry u={0}; u.type=OP_INSERT; u.after=s; push_undo(u);
+    int* ids = NULL; int ids_cap = 0;
+    int added = 0, rejected = 0, line_no = 0, undo_ok = 1;
+    char buf[MAX_LINE];
+    while (fgets(buf, sizeof(buf), fp)) {
+        line_no++;
+        size_t len = strlen(buf);
+        if (len == sizeof(buf)-1 && buf[len-1] != '\n' && !feof(fp)) {
+            int c; while ((c = fgetc(fp)) != EOF && c != '\n') {}
+            import_reject(&rejected, line_no, "line too long");
+            continue;
+        }
+        trim(buf);
+        if (!buf[0]) continue;
+        char* f[4];
+        int nf = csv_split(buf, f, 4);
+        if (line_no == 1 && nf >= 1 && strcasecmp(f[0], "ID") == 0) continue;   /* header */
+        if (nf != 4) { import_reject(&rejected, line_no, nf < 0 ? "unterminated quote" : "expected ID,Name,Programme,Mark"); continue; }
+
+        Student s;
+        if (validate_id_text(f[0], &s.id) <= 0) { import_reject(&rejected, line_no, "ID must be 7 digits"); continue; }
+        char* end;
+        strtod(f[3], &end);
+        if (end == f[3] || *end || validate_mark_text(f[3], &s.mark) <= 0) { import_reject(&rejected, line_no, "MARK must be a number in 0..100"); continue; }
+        if (find_index_by_id(s.id) >= 0) { import_reject(&rejected, line_no, "ID already exists"); continue; }
+        if (strchr(f[1], '|') || strchr(f[2], '|')) { import_reject(&rejected, line_no, "'|' is not allowed in names"); continue; }
+        strncpy(s.name, f[1], MAX_NAME-1); s.name[MAX_NAME-1] = 0;
+        strncpy(s.programme, f[2], MAX_PROG-1); s.programme[MAX_PROG-1] = 0;
+        normalise_caps(s.name);
+        normalise_caps(s.programme);
+        if (store_append(&s) < 0) { out_printf("CMS: Out of memory, import stopped at line %d.\n", line_no); break; }
+        added++;
+        if (undo_ok && added > ids_cap) {
+            int cap = ids_cap ? ids_cap*2 : 1024;
+            int* t = (int*)realloc(ids, sizeof(int)*(size_t)cap);
+            if (t) { ids = t; ids_cap = cap; } else undo_ok = 0;
+        }
+        if (undo_ok) ids[added-1] = s.id;
+    }
+    fclose(fp);
+    io_stats.imports++;
+    io_stats.import_bytes += bytes;
+    records_shrink_to_fit();
+
+    if (rejected > IMPORT_REPORT_MAX) out_printf("CMS:   ... and %d more rejected lines.\n", rejected - IMPORT_REPORT_MAX);
+    out_printf("CMS: Imported %d records from '%s' (%d rejected).\n", added, filename, rejected);
+    if (added == 0) { free(ids); return; }
+    if (undo_ok) {
+        UndoEntry u={0}; u.type=OP_IMPORT; u.ids=ids; u.count=added; push_undo(u);
+    } else {
+        free(ids);
+        out_printf("CMS: Warning: out of memory, this IMPORT cannot be undone.\n");
+    }
+    journal_stale = 1;   /* one snapshot rewrite instead of a journal line per record */
     maybe_autosave();
 }
 
-static void cmd_update(const char* line) {
-    int id; int id_ok = parse_and_validate_id(line,&id);
-    if (id_ok<=0) { printf("CMS: Please provide a valid 7-digit numeric ID for UPDATE.\n"); return; }
+static void cmd_update(const Command* cmd) {
+    int id; int id_ok = parse_and_validate_id(cmd, &id);
+    if (id_ok<=0) { out_printf("CMS: Please provide a valid 7-digit numeric ID for UPDATE.\n"); return; }
     int idx=find_index_by_id(id);
-    if (idx<0) { printf("CMS: The record with ID=%d does not exist.\n", id); return; }
+    if (idx<0) { out_printf("CMS: The record with ID=%d does not exist.\n", id); return; }
 
     char s_name[MAX_NAME], s_prog[MAX_PROG];
     int has_name=0, has_prog=0, has_mark=0; float mark=0.0f;
-    if (parse_between(line,"NAME",s_name,sizeof(s_name))) has_name=1;
-    if (parse_between(line,"PROGRAMME",s_prog,sizeof(s_prog))) has_prog=1;
-    int mk = parse_and_validate_mark(line,&mark);
+    if (cmd_value(cmd, KEY_NAME, s_name,sizeof(s_name))) has_name=1;
+    if (cmd_value(cmd, KEY_PROGRAMME, s_prog,sizeof(s_prog))) has_prog=1;
+    int mk = parse_and_validate_mark(cmd, &mark);
     if (mk==1) { has_mark=1; }
-    else if (mk==-1) { printf("CMS: MARK must be within 0..100.\n"); return; }
+    else if (mk==-1) { out_printf("CMS: MARK must be within 0..100.\n"); return; }
 
-    if (!has_name && !has_prog && !has_mark) { printf("CMS: Nothing to update. Provide NAME/PROGRAMME/MARK.\n"); return; }
+    if (!has_name && !has_prog && !has_mark) { out_printf("CMS: Nothing to update. Provide NAME/PROGRAMME/MARK.\n"); return; }
 
-    Student before = records[idx];
+    Student before; store_get(idx, &before);
+    Student after = before;
     if (has_name) { 
         normalise_caps(s_name);
-        strncpy(records[idx].name,s_name,MAX_NAME-1); 
-        records[idx].name[MAX_NAME-1]=0; 
+        strncpy(after.name,s_name,MAX_NAME-1); 
+        after.name[MAX_NAME-1]=0; 
     }
     if (has_prog) { 
         normalise_caps(s_prog);
-        strncpy(records[idx].programme,s_prog,MAX_PROG-1); 
-        records[idx].programme[MAX_PROG-1]=0; 
+        strncpy(after.programme,s_prog,MAX_PROG-1); 
+        after.programme[MAX_PROG-1]=0; 
     }
-    if (has_mark) { records[idx].mark=mark; }
+    if (has_mark) { after.mark=mark; }
+    if (!store_set(idx, &after)) { out_printf("CMS: Cannot update, out of memory.\n"); return; }
 
-    printf("CMS: The record with ID=%d is successfully updated.\n", id);
+    out_printf("CMS: The record with ID=%d is successfully updated.\n", id);
+    journal_put(&after);
 
-    UndoEntry u={0}; u.type=OP_UPDATE; u.before=before; u.after=records[idx]; u.had_before=1; push_undo(u);
+    push_undo(undo_update(&before, &after));
     maybe_autosave();
 }
 
-static void cmd_delete(const char* line) {
-    int id; int id_ok = parse_and_validate_id(line,&id);
-    if (id_ok<=0) { printf("CMS: Please provide a valid 7-digit numeric ID for DELETE.\n"); return; }
+static void cmd_delete(const Command* cmd) {
+    int id; int id_ok = parse_and_validate_id(cmd, &id);
+    if (id_ok<=0) { out_printf("CMS: Please provide a valid 7-digit numeric ID for DELETE.\n"); return; }
     int idx=find_index_by_id(id);
-    if (idx<0) { printf("CMS: The record with ID=%d does not exist.\n", id); return; }
+    if (idx<0) { out_printf("CMS: The record with ID=%d does not exist.\n", id); return; }
 
-    printf("CMS: Are you sure you want to delete record with ID=%d? Type \"Y\" to Confirm or type \"N\" to cancel.\n", id);
-    printf("You: ");
+    /* CONFIRM=Y|N answers up front; server clients must, since a prompt would hold the write lock */
     char resp[32];
-    if (!fgets(resp,sizeof(resp),stdin)) return;
+    if (!cmd_value(cmd, KEY_CONFIRM, resp,sizeof(resp))) {
+        if (session->client) {
+            out_printf("CMS: Add CONFIRM=Y to delete from a server connection, e.g. DELETE ID=%d CONFIRM=Y\n", id);
+            return;
+        }
+        out_printf("CMS: Are you sure you want to delete record with ID=%d? Type \"Y\" to Confirm or type \"N\" to cancel.\n", id);
+        out_printf("You: ");
+        fflush(session->out);
+        if (!fgets(resp,sizeof(resp),session->in)) return;
+    }
     trim(resp);
-    if (resp[0]!='Y' && resp[0]!='y') { printf("CMS: The deletion is cancelled.\n"); return; }
+    if (resp[0]!='Y' && resp[0]!='y') { out_printf("CMS: The deletion is cancelled.\n"); return; }
 
-    Student before=records[idx];
-    for (int i=idx+1;i<n_records;++i) records[i-1]=records[i];
-    n_records--;
-    printf("CMS: The record with ID=%d is successfully deleted.\n", id);
+    Student before; store_get(idx, &before);
+    store_remove_at(idx);
+    out_printf("CMS: The record with ID=%d is successfully deleted.\n", id);
+    journal_del(id);
 
-    UndoEntry u={0}; u.type=OP_DELETE; u.before=before; u.had_before=1; push_undo(u);
+    push_undo(undo_record(OP_DELETE, &before));
     maybe_autosave();
 }
 
+/* copies the records of an OP_IMPORT on the undo stack into it so REDO can
+   add them back. Read as it is undone, when every later step has been undone
+   and the records are as IMPORT left them; 0 when out of memory */
+static int import_keep_rows(UndoEntry* u) {
+    size_t len = 0;
+    for (int k=0;k<u->count;++k) {
+        int idx = find_index_by_id(u->ids[k]);
+        if (idx < 0) return 0;
+        len += strlen(rec_name(idx))+1 + strlen(rec_prog(idx))+1;
+    }
+    float* marks = (float*)malloc(sizeof(float)*(size_t)u->count);
+    char* text = (char*)malloc(len ? len : 1);
+    if (!marks || !text) { free(marks); free(text); return 0; }
+    char* t = text;
+    for (int k=0;k<u->count;++k) {
+        int idx = find_index_by_id(u->ids[k]);
+        size_t ln = strlen(rec_name(idx))+1, lp = strlen(rec_prog(idx))+1;
+        memcpy(t, rec_name(idx), ln); t += ln;
+        memcpy(t, rec_prog(idx), lp); t += lp;
+        marks[k] = col_mark[idx];
+    }
+    undo_bytes -= undo_entry_bytes(u);
+    u->marks = marks; u->text = text;
+    undo_bytes += undo_entry_bytes(u);
+    return 1;
+}
+
+/* applies u backwards (UNDO, rollback) or forwards (REDO); 1 = done,
+   0 = the record is missing (or, when putting it back, already there), -1 = out of memory */
+static int undo_apply(UndoEntry* u, int redo) {
+    if (u->type==OP_INSERT || u->type==OP_DELETE) {
+        int idx = find_index_by_id(u->id);
+        if ((u->type==OP_INSERT) != redo) {   /* take the record out */
+            if (idx<0) return 0;
+            store_remove_at(idx);
+            journal_del(u->id);
+        } else {                              /* put it back */
+            if (idx>=0) return 0;
+            Student s;
+            undo_side(u, redo, &s);
+            if (store_append(&s) < 0) return -1;
+            journal_put(&s);
+        }
+    } else if (u->type==OP_UPDATE) {
+        int idx = find_index_by_id(u->id);
+        if (idx<0) return 0;
+        Student s;
+        store_get(idx, &s);
+        undo_side(u, redo, &s);
+        if (!store_set(idx, &s)) return -1;
+        journal_put(&s);
+    } else if (u->type==OP_GROUP) {
+        for (int j=0;j<u->count;++j) {
+            if (undo_apply(&u->group[redo ? j : u->count-1-j], redo) < 0) return -1;
+        }
+    } else if (u->type==OP_IMPORT && redo) {
+        if (!u->marks) return 0;
+        for (int k=0;k<u->count;++k) if (find_index_by_id(u->ids[k]) >= 0) return 0;
+        const char* t = u->text;
+        for (int k=0;k<u->count;++k) {
+            Student s;
+            s.id = u->ids[k];
+            snprintf(s.name, sizeof(s.name), "%s", t); t += strlen(t)+1;
+            snprintf(s.programme, sizeof(s.programme), "%s", t); t += strlen(t)+1;
+            s.mark = u->marks[k];
+            if (store_append(&s) < 0) { journal_stale = 1; return -1; }
+        }
+        journal_stale = 1;   /* one snapshot rewrite instead of a journal line per record */
+    } else if (u->type==OP_IMPORT) {
+        if (!txn_open && !u->marks) import_keep_rows(u);   /* without them REDO cannot add the records back */
+        store_remove_ids(u->ids, u->count);
+        journal_stale = 1;
+    }
+    return 1;
+}
+
+/* UNDO/REDO outcome line for undo_apply's result r */
+static void undo_report(const UndoEntry* u, int redo, int r) {
+    static const char* const op_names[] = { "", "INSERT", "UPDATE", "DELETE" };
+    const char* cmd = redo ? "REDO" : "UNDO";
+    if (r < 0) {
+        out_printf("CMS: %s failed%s (out of memory).\n", cmd, u->type==OP_GROUP ? " part-way" : "");
+    } else if (r == 0) {
+        int adds = (u->type==OP_INSERT || u->type==OP_IMPORT) == redo;
+        out_printf("CMS: %s failed (record %s).\n", cmd, adds ? "already exists" : "not found");
+    } else if (u->type==OP_GROUP) {
+        if (redo) out_printf("CMS: REDO successful (reapplied transaction of %d changes).\n", u->count);
+        else out_printf("CMS: UNDO successful (reverted last transaction of %d changes).\n", u->count);
+    } else if (u->type==OP_IMPORT) {
+        if (redo) out_printf("CMS: REDO successful (reapplied IMPORT of %d records).\n", u->count);
+        else out_printf("CMS: UNDO successful (reverted last IMPORT of %d records).\n", u->count);
+    } else if (redo) {
+        out_printf("CMS: REDO successful (reapplied %s of ID=%d).\n", op_names[u->type], u->id);
+    } else {
+        out_printf("CMS: UNDO successful (reverted last %s of ID=%d).\n", op_names[u->type], u->id);
+    }
+}
+
 static void cmd_undo(void) {
-    if (undo_top<=0) { printf("CMS: Nothing to UNDO.\n"); return; }
-    UndoEntry u = undo_stack[--undo_top];
-    if (u.type==OP_INSERT) {
-        int idx=find_index_by_id(u.after.id);
-        if (idx>=0) { for (int i=idx+1;i<n_records;++i) records[i-1]=records[i]; n_records--; printf("CMS: UNDO successful (reverted last INSERT of ID=%d).\n",u.after.id); }
-        else printf("CMS: UNDO failed (record not found).\n");
-    } else if (u.type==OP_UPDATE) {
-        int idx=find_index_by_id(u.before.id);
-        if (idx>=0) { records[idx]=u.before; printf("CMS: UNDO successful (reverted last UPDATE of ID=%d).\n",u.before.id); }
-        else printf("CMS: UNDO failed (record not found).\n");
-    } else if (u.type==OP_DELETE) {
-        if (n_records>=MAX_RECORDS) { printf("CMS: UNDO failed (max records reached).\n"); return; }
-        records[n_records++]=u.before;
-        printf("CMS: UNDO successful (reverted last DELETE of ID=%d).\n",u.before.id);
+    if (txn_open ? txn_n<=0 : undo_n<=0) { out_printf("CMS: Nothing to UNDO.\n"); return; }
+    UndoEntry* u = txn_open ? &txn_log[txn_n-1] : &UNDO_AT(undo_n-1);
+    if (u->type==OP_GROUP) journal_block_begin();
+    int r = undo_apply(u, 0);
+    int keep = u->type!=OP_IMPORT || u->marks;
+    if (u->type==OP_GROUP) journal_block_end(1);
+    undo_report(u, 0, r);
+    int group = u->type==OP_GROUP;
+    if (txn_open) {
+        txn_n--;
+        undo_entry_free(u);
+    } else if (r > 0 && keep) {
+        undo_n--;   /* stays in the ring for REDO */
+        redo_n++;
+    } else if (r > 0) {
+        /* an IMPORT whose rows could not be kept: drop it alone, the steps undone before it can still be redone */
+        undo_bytes -= undo_entry_bytes(u);
+        undo_entry_free(u);
+        for (int i=0;i<redo_n;++i) UNDO_AT(undo_n-1+i) = UNDO_AT(undo_n+i);
+        undo_n--;
     } else {
-        printf("CMS: UNDO failed (unknown op).\n");
+        /* a failed step cannot be redone */
+        redo_clear();
+        undo_bytes -= undo_entry_bytes(u);
+        undo_entry_free(u);
+        undo_n--;
     }
-    maybe_autosave();
+    if (r >= 0 || group) maybe_autosave();   /* a group may have half-applied */
+}
+
+static void cmd_redo(void) {
+    if (txn_open) { out_printf("CMS: REDO is not available inside a transaction.\n"); return; }
+    if (redo_n<=0) { out_printf("CMS: Nothing to REDO.\n"); return; }
+    UndoEntry* u = &UNDO_AT(undo_n);
+    if (u->type==OP_GROUP) journal_block_begin();
+    int r = undo_apply(u, 1);
+    if (u->type==OP_GROUP) journal_block_end(1);
+    undo_report(u, 1, r);
+    int group = u->type==OP_GROUP;
+    if (r > 0) {
+        undo_n++;
+        redo_n--;
+    } else {
+        redo_clear();
+    }
+    if (r > 0 || group) maybe_autosave();
+}
+
+/* shrinks the history to a new budget, keeping at least the newest step */
+static void undo_set_budget(size_t bytes) {
+    undo_budget = bytes;
+    if (undo_bytes > undo_budget) redo_clear();
+    while (undo_n > 1 && undo_bytes > undo_budget) undo_drop_oldest();
+}
+
+static void cmd_begin(void) {
+    if (txn_open) { out_printf("CMS: A transaction is already open. COMMIT or ROLLBACK it first.\n"); return; }
+    txn_open = 1;
+    txn_owner = session->client;
+    txn_n = 0;
+    journal_block_begin();
+    out_printf("CMS: Transaction started. Changes are saved together on COMMIT or discarded by ROLLBACK.\n");
+}
+
+static void cmd_commit(void) {
+    if (!txn_open) { out_printf("CMS: No open transaction. Use BEGIN first.\n"); return; }
+    txn_open = 0;
+    int n = txn_n;
+    if (n == 1) {
+        push_undo(txn_log[0]);
+    } else if (n > 1) {
+        UndoEntry g={0}; g.type=OP_GROUP; g.group=txn_log; g.count=n;
+        push_undo(g);
+        txn_log = NULL; txn_cap = 0;
+    }
+    txn_n = 0;
+    journal_block_end(1);
+    out_printf("CMS: Transaction committed (%d changes).\n", n);
+    if (n > 0) maybe_autosave();
+}
+
+/* reverts and drops the open transaction; 0 if out of memory left it half reverted */
+static int txn_rollback(void) {
+    int failed = 0;
+    while (txn_n > 0) {
+        UndoEntry* u = &txn_log[--txn_n];
+        if (undo_apply(u, 0) < 0) failed = 1;
+        undo_entry_free(u);
+    }
+    txn_open = 0;
+    journal_block_end(0);
+    return !failed;
+}
+
+static void cmd_rollback(void) {
+    if (!txn_open) { out_printf("CMS: No open transaction. Use BEGIN first.\n"); return; }
+    int n = txn_n;
+    if (!txn_rollback()) out_printf("CMS: ROLLBACK incomplete (out of memory). Please re-OPEN the database.\n");
+    else out_printf("CMS: Transaction rolled back (%d changes reverted).\n", n);
 }
 
 
-static void cmd_find_name(const char* line) {
+static void cmd_find_name(const Command* cmd) {
     char key_name[MAX_NAME];
     char key_prog[MAX_PROG];
-    int has_name = parse_between(line,"NAME",key_name,sizeof(key_name));
-    int has_prog = parse_between(line,"PROGRAMME",key_prog,sizeof(key_prog));
+    int has_name = cmd_value(cmd, KEY_NAME, key_name,sizeof(key_name));
+    int has_prog = cmd_value(cmd, KEY_PROGRAMME, key_prog,sizeof(key_prog));
 
     if (!has_name && !has_prog) {
-        printf("CMS: Please provide NAME or PROGRAMME keyword, e.g., FIND NAME=\"michelle\" or FIND PROGRAMME=\"Digital Supply Chain\".\n");
+        out_printf("CMS: Please provide NAME or PROGRAMME keyword, e.g., FIND NAME=\"michelle\" or FIND PROGRAMME=\"Digital Supply Chain\".\n");
         return;
     }
 
     if (has_name) {
         char key_lc[MAX_NAME]; strncpy(key_lc,key_name,sizeof(key_lc)-1); key_lc[sizeof(key_lc)-1]=0;
         for (char* p=key_lc; *p; ++p) *p=(char)tolower((unsigned char)*p);
+        FoldKey key = { key_lc, strlen(key_lc) };
         int found=0;
-        printf("CMS: Search results for name contains \"%s\":\n", key_name);
+        out_printf("CMS: Search results for name contains \"%s\":\n", key_name);
         print_record_header();
-        for (int i=0;i<n_records;++i) {
-            char name_lc[MAX_NAME]; strncpy(name_lc,records[i].name,sizeof(name_lc)-1); name_lc[sizeof(name_lc)-1]=0;
-            for (char* p=name_lc; *p; ++p) *p=(char)tolower((unsigned char)*p);
-            if (strstr(name_lc,key_lc)) { print_record(&records[i]); found=1; }
+        const int* cand; int nc = -1;
+        if (name_tri_ready()) nc = tri_candidates(&name_tri, key_lc, &cand);
+        int* hits = nc > 0 ? (int*)malloc(sizeof(int)*(size_t)nc) : NULL;
+        if (nc > 0 && hits) {
+            /* verify the candidates, then print them in store order */
+            int nh = 0;
+            for (int j=0;j<nc;++j) {
+                int slot = id_index_get(cand[j]);
+                if (slot >= 0 && fold_contains(rec_fold(slot), key.key, key.n)) hits[nh++] = slot;
+            }
+            qsort(hits, (size_t)nh, sizeof(int), cmp_int_asc);
+            for (int j=0;j<nh;++j) print_record(hits[j]);
+            found = nh > 0;
+        } else if (nc != 0) {
+            found = print_scan(name_scan, &key);
         }
-        if (!found) printf("(no matches)\n");
+        out_flush(session->rows);
+        free(hits);
+        if (found < 0) out_printf("CMS: Memory error.\n");
+        else if (!found) out_printf("(no matches)\n");
         return;
     }
 
     if (has_prog) {
-        char key_lc[MAX_PROG]; strncpy(key_lc,key_prog,sizeof(key_lc)-1); key_lc[sizeof(key_lc)-1]=0;
-        for (char* p=key_lc; *p; ++p) *p=(char)tolower((unsigned char)*p);
-        int found=0;
-        printf("CMS: Search results for programme contains \"%s\":\n", key_prog);
+        unsigned char* match = match_programmes(key_prog, 1);
+        if (!match) { out_printf("CMS: Memory error.\n"); return; }
+        out_printf("CMS: Search results for programme contains \"%s\":\n", key_prog);
         print_record_header();
-        for (int i=0;i<n_records;++i) {
-            char prog_lc[MAX_PROG]; strncpy(prog_lc,records[i].programme,sizeof(prog_lc)-1); prog_lc[sizeof(prog_lc)-1]=0;
-            for (char* p=prog_lc; *p; ++p) *p=(char)tolower((unsigned char)*p);
-            if (strstr(prog_lc,key_lc)) { print_record(&records[i]); found=1; }
+        int any=0;
+        for (int p=0;p<n_progs;++p) any |= match[p];
+        int found = any ? print_scan(prog_scan, match) : 0;
+        out_flush(session->rows);
+        free(match);
+        if (found < 0) out_printf("CMS: Memory error.\n");
+        else if (!found) out_printf("(no matches)\n");
+    }
+}
+
+/* EXPORT <format>="file" [NAME=".."] [PROGRAMME=".."] [WHERE ...] [SORT BY ...] [LIMIT n [OFFSET m] | TOP n]
+   writes the rows FIND, SHOW WHERE and SHOW ALL would list, in the same order */
+static void cmd_export(const Command* cmd) {
+    if (n_records == 0) {
+        out_printf("CMS: No records loaded. Nothing to export.\n");
+        return;
+    }
+    char filename[256];
+    int fmt = 0;
+    while (fmt < EXP_FORMATS && !cmd_value(cmd, export_formats[fmt].key, filename, sizeof(filename))) fmt++;
+    if (fmt == EXP_FORMATS) {
+        out_printf("CMS: Please specify CSV, JSONL, TSV or BIN=\"<filename>\". e.g., EXPORT CSV=\"students.csv\"\n");
+        return;
+    }
+    char key_name[MAX_NAME], key_prog[MAX_PROG];
+    int has_name = cmd_value(cmd, KEY_NAME, key_name, sizeof(key_name));
+    int has_prog = cmd_value(cmd, KEY_PROGRAMME, key_prog, sizeof(key_prog));
+    for (char* c=key_name; has_name && *c; ++c) *c = (char)tolower((unsigned char)*c);
+    FoldKey name = { key_name, has_name ? strlen(key_name) : 0 };
+
+    /* the rows: WHERE's matches (or FIND's scan), narrowed by the NAME and PROGRAMME substrings */
+    const char* opts = cmd->opts;
+    int* hits = NULL;
+    int nh = n_records;
+    unsigned char* match = NULL;
+    if (has_prog && !(match = match_programmes(key_prog, 1))) { out_printf("CMS: Memory error.\n"); return; }
+    if (cmd->where) {
+        Filter f;
+        const char* bad;
+        opts = filter_compile(cmd->where, &f, &bad);
+        if (!opts) { filter_free(&f); free(match); filter_error(bad); return; }
+        hits = filter_run(&f, &nh);
+        filter_free(&f);
+    } else if (has_name || has_prog) {
+        hits = (int*)malloc(sizeof(int)*(size_t)n_records);
+        if (hits) nh = has_name ? scan_slots(n_records, name_scan, &name, hits) : scan_slots(n_records, prog_scan, match, hits);
+    }
+    if ((cmd->where || has_name || has_prog) && !hits) { free(match); out_printf("CMS: Memory error.\n"); return; }
+    int test_name = has_name && cmd->where, test_prog = has_prog && (cmd->where || has_name);   /* not done by the scan */
+    if (test_name || test_prog) {
+        int w = 0;
+        for (int r=0;r<nh;++r) {
+            int slot = hits[r];
+            if ((!test_name || fold_contains(rec_fold(slot), name.key, name.n)) && (!test_prog || match[col_prog[slot]])) hits[w++] = slot;
         }
-        if (!found) printf("(no matches)\n");
+        nh = w;
+    }
+    free(match);
+    ShowOpts so;
+    if (!parse_show_opts(opts, &so)) { free(hits); return; }
+    int first, count;
+    show_range(&so, nh, &first, &count);
+
+    /* the slots in output order; none needed for an unsorted, unfiltered range */
+    int* rows = NULL;
+    int ok = 1;
+    if (hits || so.sort_by >= 0) {
+        int* at = rows = (int*)malloc(sizeof(int)*(size_t)(count ? count : 1));
+        const int* order = NULL;
+        if (!rows) ok = 0;
+        else if (hits) ok = rows_walk(hits, nh, &so, first, count, visit_collect, &at);
+        else if ((order = sort_order_get((SortKey)so.sort_by)) != NULL)
+            sort_order_walk((SortKey)so.sort_by, order, so.desc, first, count, visit_collect, &at);
+        else ok = 0;
+    }
+    free(hits);
+    if (!ok) { free(rows); out_printf("CMS: Memory error.\n"); return; }
+
+    FILE* fp = fopen(filename, fmt == EXP_BIN ? "wb" : "w");
+    if (!fp) {
+        free(rows);
+        out_printf("CMS: Failed to open %s file '%s' for writing.\n", export_formats[fmt].name, filename);
+        return;
+    }
+    BinHeader h;
+    uint64_t sum = CHECKSUM_SEED;
+    if (fmt == EXP_BIN) {
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, BIN_MAGIC, 4);
+        h.version = BIN_VERSION;
+        h.header_size = sizeof(BinHeader);
+        h.record_size = sizeof(BinRecord);
+        h.count = (uint32_t)count;
+        h.byte_order = BIN_BYTE_ORDER;
+        ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    } else {
+        ok = fputs(export_formats[fmt].header, fp) >= 0;
+    }
+    ok = ok && export_write_rows(fp, export_formats[fmt].row, rows, first, count, fmt == EXP_BIN ? &sum : NULL);
+    if (ok && fmt == EXP_BIN) {
+        h.checksum = sum;
+        ok = fseek(fp, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, fp) == 1 && fseek(fp, 0, SEEK_END) == 0;
+    }
+    free(rows);
+    cms_mutex_lock(&misc_lock);   /* EXPORT runs under the shared lock */
+    io_stats.exports++;
+    io_stats.export_bytes += ftell(fp);
+    cms_mutex_unlock(&misc_lock);
+    if (fclose(fp) != 0) ok = 0;
+    if (ok) out_printf("CMS: Exported %d records to '%s'.\n", count, filename);
+    else out_printf("CMS: Failed to write %s file '%s'.\n", export_formats[fmt].name, filename);
+}
+
+static size_t tri_index_bytes(const TriIndex* ix) {
+    size_t cap = ix->lists ? (size_t)1 << ix->bits : 0, b = cap*sizeof(TriList);
+    for (size_t i=0;i<cap;++i) b += (size_t)ix->lists[i].cap*sizeof(int);
+    return b;
+}
+
+static void cmd_stats(void) {
+    cms_mutex_lock(&misc_lock);
+    out_printf("CMS: Statistics since start:\n");
+    out_printf("%-22s %6s %10s %9s %6s %6s %6s %6s %6s %6s %6s\n", "Command", "Calls", "Total ms", "Max ms",
+           "<10us", "<100us", "<1ms", "<10ms", "<100ms", "<1s", ">=1s");
+    for (int k=0;k<ST_KINDS;++k) {
+        const CmdStat* s = &stat_table[k];
+        if (!s->calls) continue;
+        out_printf("%-22.22s %6ld %10.3f %9.3f", stat_names[k], s->calls, s->total_ms, s->max_ms);
+        for (int b=0;b<STAT_BUCKETS;++b) out_printf(" %6ld", s->hist[b]);
+        out_printf("\n");
     }
+    out_printf("I/O:\n");
+    out_printf("  load    %ld file(s), %lld bytes read\n", io_stats.loads, io_stats.load_bytes);
+    out_printf("  journal %ld replay(s), %lld bytes read, %lld bytes appended\n",
+           io_stats.replays, io_stats.replay_bytes, io_stats.journal_bytes);
+    out_printf("  save    %ld file(s), %lld bytes written\n", io_stats.saves, io_stats.save_bytes);
+    out_printf("  export  %ld file(s), %lld bytes written\n", io_stats.exports, io_stats.export_bytes);
+    out_printf("  import  %ld file(s), %lld bytes read\n", io_stats.imports, io_stats.import_bytes);
+    out_printf("Autosave: %ld run(s), %ld snapshot rewrite(s), %.3f ms total, %.3f ms max\n",
+           io_stats.autosaves, io_stats.autosave_compactions, io_stats.autosave_ms, io_stats.autosave_max_ms);
+    out_printf("Parsing: %ld line(s), %.3f ms total, %.3f ms max\n",
+           parse_stats.lines, parse_stats.total_ms, parse_stats.max_ms);
+    cms_mutex_unlock(&misc_lock);
+
+    size_t columns = (size_t)records_cap*(sizeof(*col_id)+sizeof(*col_mark)+sizeof(*col_name)+sizeof(*col_prog));
+    size_t progs = (size_t)progs_cap*2*sizeof(char*) + (prog_table ? sizeof(int) << prog_table_bits : 0);
+    for (int p=0;p<n_progs;++p) progs += 2*(strlen(prog_str[p])+1) + FOLD_PAD;   /* text and folded shadow */
+    size_t names = name_fold ? 2*name_cap + FOLD_PAD : name_cap;
+    size_t ids = id_index ? sizeof(IdSlot) << id_index_bits : 0, sorts = 0;
+    cms_mutex_lock(&index_lock);
+    for (int k=0;k<SORT_KEYS;++k) sorts += (size_t)sort_orders[k].cap*sizeof(int);
+    size_t tris = tri_index_bytes(&name_tri) + tri_index_bytes(&prog_tri);
+    cms_mutex_unlock(&index_lock);
+    /* entry sizes count their slot; the ring and the transaction log are counted whole */
+    size_t undo = (size_t)(undo_cap+txn_cap)*sizeof(UndoEntry) + batch_cap;
+    undo += undo_bytes - (size_t)(undo_n+redo_n)*sizeof(UndoEntry);
+    for (int i=0;i<txn_n;++i) undo += undo_entry_bytes(&txn_log[i]) - sizeof(UndoEntry);
+    out_printf("Memory (KB): records %.1f (columns %.1f, names %.1f, programmes %.1f)\n",
+           (columns+names+progs)/1024.0, columns/1024.0, names/1024.0, progs/1024.0);
+    out_printf("             indexes %.1f (ID %.1f, sort orders %.1f, trigram %.1f)\n",
+           (ids+sorts+tris)/1024.0, ids/1024.0, sorts/1024.0, tris/1024.0);
+    out_printf("             undo %.1f (%d steps, %d to redo), history %.1f\n",
+           undo/1024.0, undo_n, redo_n, sizeof(command_history)/1024.0);
 }
 
 static void cmd_help(void) {
-    printf("Available commands:\n");
-    printf("  OPEN <TeamName>\n");
-    printf("  SHOW ALL [SORT BY ID|MARK|PROGRAMME [ASC|DESC]]\n");
-    printf("  SHOW SUMMARY\n");
-    printf("  SHOW PROGRAMME SUMMARY\n");
-    printf("  INSERT ID=<int> Name=\"<str>\" Programme=\"<str>\" Mark=<float>\n");
-    printf("  QUERY  ID=<int>\n");
-    printf("  UPDATE ID=<int> [Name=\"<str>\"] [Programme=\"<str>\"] [Mark=<float> (0..100)]\n");
-    printf("  DELETE ID=<int>\n");
-    printf("  FIND NAME=\"<keyword>\"\n");
-    printf("  FIND PROGRAMME=\"<keyword>\"\n");
-    printf("  SET AUTOSAVE ON|OFF\n");
-    printf("  SAVE\n");
-    printf("  UNDO\n");
-    printf("  HELP\n");
-    printf("  EXIT\n");
+    out_printf("Available commands:\n");
+    out_printf("  OPEN <TeamName>\n");
+    out_printf("  SHOW ALL [SORT BY ID|MARK|PROGRAMME|NAME [ASC|DESC]] [LIMIT n [OFFSET m] | TOP n]\n");
+    out_printf("  SHOW WHERE Mark>=70 AND Programme=\"<str>\" AND ID BETWEEN <a> AND <b> [SORT BY ...] [LIMIT n | TOP n]\n");
+    out_printf("  SHOW SUMMARY\n");
+    out_printf("  SHOW PROGRAMME SUMMARY\n");
+    out_printf("  INSERT ID=<int> Name=\"<str>\" Programme=\"<str>\" Mark=<float>\n");
+    out_printf("  QUERY  ID=<int>\n");
+    out_printf("  UPDATE ID=<int> [Name=\"<str>\"] [Programme=\"<str>\"] [Mark=<float> (0..100)]\n");
+    out_printf("  DELETE ID=<int> [CONFIRM=Y|N]\n");
+    out_printf("  FIND NAME=\"<keyword>\"\n");
+    out_printf("  FIND PROGRAMME=\"<keyword>\"\n");
+    out_printf("  SET AUTOSAVE ON|OFF\n");
+    out_printf("  SET FSYNC ON|OFF|<n>\n");
+    out_printf("  SET FORMAT TEXT|BINARY|COMPACT [LZ]\n");
+    out_printf("  SET UNDO <KB>\n");
+    out_printf("  SET THREADS <n>   (0 = one per CPU)\n");
+    out_printf("  EXPORT CSV|JSONL|TSV|BIN=\"<file>\" [NAME=\"..\"] [PROGRAMME=\"..\"] [WHERE ...] [SORT BY ...] [LIMIT n [OFFSET m] | TOP n]\n");
+    out_printf("  IMPORT CSV=\"<filename.csv>\"\n");
+    out_printf("  SAVE\n");
+    out_printf("  UNDO | REDO\n");
+    out_printf("  BEGIN | COMMIT | ROLLBACK   (--serve: other clients wait for the COMMIT or ROLLBACK)\n");
+    out_printf("  TIMING ON|OFF\n");
+    out_printf("  STATS\n");
+    out_printf("  HELP\n");
+    out_printf("  EXIT\n");
 }
 
 static void ensure_filename_from_team(void) {
-    if (team_name[0]) snprintf(db_filename,sizeof(db_filename),"%s-CMS.txt", team_name);
+    if (team_name[0]) {
+        snprintf(db_filename,sizeof(db_filename),"%s-CMS.txt", team_name);
+        snprintf(journal_filename,sizeof(journal_filename),"%s-CMS.journal", team_name);
+    }
+}
+
+/* ---- Command dispatch ---- */
+
+/* runs one lexed command. 0 ends the session */
+static int dispatch(const Command* cmd) {
+    if (txn_open && (cmd->kind==CMD_OPEN || cmd->kind==CMD_SAVE)) {
+        out_printf("CMS: A transaction is open. COMMIT or ROLLBACK it first.\n");
+        return 1;
+    }
+    switch (cmd->kind) {
+    case CMD_EXIT:
+        if (txn_open && txn_owner == session->client) {
+            out_printf("CMS: Uncommitted transaction discarded (%d changes not saved).\n", txn_n);
+        }
+        if (!session->client) {   /* a server client's EXIT only ends its connection */
+            save_drain();
+            save_report();
+            journal_close();
+        }
+        out_printf("CMS: Bye!\n");
+        return 0;
+    case CMD_HELP:
+        cmd_help();
+        break;
+    case CMD_OPEN: {
+        const char* p = cmd->args;
+        if (!*p) { out_printf("CMS: Please provide a team name. e.g., OPEN P10-09\n"); return 1; }
+        save_drain();   /* the previous database's saves land first */
+        save_report();
+        strncpy(team_name,p,sizeof(team_name)-1); team_name[sizeof(team_name)-1]=0; trim(team_name);
+        journal_close();
+        ensure_filename_from_team();
+        int loaded = load_db(db_filename);
+        if (loaded < 0) {
+            out_printf("CMS: \"%s\" is not a valid database file (bad header or checksum). Nothing opened.\n", db_filename);
+            store_clear();
+            db_filename[0]=0; journal_filename[0]=0; team_name[0]=0;
+            return 1;
+        }
+        if (!loaded) {
+            store_clear();
+            snapshot_bytes=0;
+        }
+        journal_stale = 0;
+        int replayed = journal_replay();
+        if (replayed > 0) {
+            out_printf("CMS: Replayed %d journal entries from \"%s\".\n", replayed, journal_filename);
+        }
+        if (loaded || replayed > 0) {
+            out_printf("CMS: Opened \"%s\" (%d records%s).\n", db_filename, n_records,
+                   format_note[db_format]);
+        } else {
+            out_printf("CMS: New database will be created on SAVE → \"%s\" (0 records currently).\n", db_filename);
+        }
+        break;
+    }
+    case CMD_SHOW_ALL: cmd_show_all(cmd); break;
+    case CMD_SHOW_PROG_SUMMARY: cmd_show_programme_summary(); break;
+    case CMD_SHOW_PROG: cmd_show_programme_exact(cmd); break;
+    case CMD_SHOW_SUMMARY: cmd_show_summary(); break;
+    case CMD_INSERT: cmd_insert(cmd); break;
+    case CMD_QUERY: cmd_query(cmd); break;
+    case CMD_UPDATE: cmd_update(cmd); break;
+    case CMD_DELETE: cmd_delete(cmd); break;
+    case CMD_FIND: cmd_find_name(cmd); break;
+    case CMD_SET_AUTOSAVE:
+        if (word_is(cmd->args,"ON")) { autosave_on=1; out_printf("CMS: AUTOSAVE is ON.\n"); }
+        else if (word_is(cmd->args,"OFF")) { autosave_on=0; out_printf("CMS: AUTOSAVE is OFF.\n"); }
+        else { out_printf("CMS: Usage → SET AUTOSAVE ON|OFF\n"); }
+        break;
+    case CMD_SET_FORMAT:
+        if (word_is(cmd->args,"BINARY")) { db_format=FMT_BINARY; out_printf("CMS: SAVE will write the BINARY snapshot format.\n"); }
+        else if (word_is(cmd->args,"TEXT")) { db_format=FMT_TEXT; out_printf("CMS: SAVE will write the TEXT format.\n"); }
+        else if (word_is(cmd->args,"COMPACT")) {
+            const char* p = cmd->args + 7;
+            while (isspace((unsigned char)*p)) p++;
+            if (!*p) { db_format=FMT_COMPACT; out_printf("CMS: SAVE will write the COMPACT format.\n"); }
+            else if (word_is(p,"LZ")) { db_format=FMT_COMPACT_LZ; out_printf("CMS: SAVE will write the COMPACT format with LZ blocks.\n"); }
+            else out_printf("CMS: Usage → SET FORMAT TEXT|BINARY|COMPACT [LZ]\n");
+        }
+        else { out_printf("CMS: Usage → SET FORMAT TEXT|BINARY|COMPACT [LZ]\n"); }
+        break;
+    case CMD_SET_FSYNC: {
+        const char* p = cmd->args;
+        if (word_is(p,"ON")) fsync_every=1;
+        else if (word_is(p,"OFF")) fsync_every=0;
+        else if (isdigit((unsigned char)*p)) fsync_every=atoi(p);
+        else { out_printf("CMS: Usage → SET FSYNC ON|OFF|<n>\n"); break; }
+        if (fsync_every>0) out_printf("CMS: Journal fsync every %d autosave(s).\n", fsync_every);
+        else out_printf("CMS: Journal fsync is OFF.\n");
+        break;
+    }
+    case CMD_SET_UNDO: {
+        if (!isdigit((unsigned char)*cmd->args)) { out_printf("CMS: Usage → SET UNDO <KB>\n"); break; }
+        long kb = atol(cmd->args);
+        undo_set_budget((size_t)kb*1024);
+        out_printf("CMS: UNDO history limited to %ld KB (%d step(s) kept).\n", kb, undo_n);
+        break;
+    }
+    case CMD_SET_THREADS: {
+        if (!isdigit((unsigned char)*cmd->args) || atol(cmd->args) > POOL_MAX) {
+            out_printf("CMS: Usage → SET THREADS <n> (0..%d, 0 = one per CPU)\n", POOL_MAX);
+            break;
+        }
+        cms_threads = (int)atol(cmd->args);
+        if (cms_threads > 0) out_printf("CMS: Bulk work uses %d thread(s).\n", cms_threads);
+        else out_printf("CMS: Bulk work uses one thread per CPU (%d).\n", cms_cpu_count());
+        break;
+    }
+    case CMD_IMPORT: cmd_import_csv(cmd); break;
+    case CMD_EXPORT: cmd_export(cmd); break;
+    case CMD_SAVE:
+        if (!db_filename[0]) { out_printf("CMS: Please OPEN <TeamName> first.\n"); }
+        else if (save_start(session->client, 0)) {
+            out_printf("CMS: Saving \"%s\" in the background (%d records).\n", db_filename, n_records);
+        } else {
+            out_printf("CMS: Saving \"%s\" after the save already running (%d records).\n", db_filename, n_records);
+        }
+        break;
+    case CMD_UNDO: cmd_undo(); break;
+    case CMD_REDO: cmd_redo(); break;
+    case CMD_BEGIN: cmd_begin(); break;
+    case CMD_COMMIT: cmd_commit(); break;
+    case CMD_ROLLBACK: cmd_rollback(); break;
+    case CMD_HISTORY: cmd_history(); break;
+    case CMD_STATS: cmd_stats(); break;
+    case CMD_TIMING:
+        if (word_is(cmd->args,"ON")) { session->timing_on=1; out_printf("CMS: TIMING is ON.\n"); }
+        else if (word_is(cmd->args,"OFF")) { session->timing_on=0; out_printf("CMS: TIMING is OFF.\n"); }
+        else { out_printf("CMS: Usage → TIMING ON|OFF\n"); }
+        break;
+    default:
+        out_printf("CMS: Unknown command. Type HELP.\n");
+        break;
+    }
+    return 1;
+}
+
+/* commands that never change the store; they run concurrently under the shared lock */
+static int reads_only(StatKind k) {
+    switch (k) {
+    case ST_SHOW_ALL: case ST_SHOW_SUMMARY: case ST_SHOW_PROG_SUMMARY: case ST_SHOW_PROG:
+    case ST_QUERY: case ST_FIND: case ST_EXPORT: case ST_HISTORY: case ST_STATS: case ST_OTHER:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* commands that only touch records through the ID index, so tombstones may stay */
+static int point_op(StatKind k) {
+    switch (k) {
+    case ST_INSERT: case ST_QUERY: case ST_UPDATE: case ST_DELETE: case ST_UNDO: case ST_TXN:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* commands that do not look at the table, open to every client during another's transaction */
+static int outside_txn(CmdKind k) {
+    return k == CMD_UNKNOWN || k == CMD_EXIT || k == CMD_HELP || k == CMD_TIMING;
+}
+
+/* locks, times and runs one trimmed command line for the current session; 0 ends the session */
+static int run_command(const char* line) {
+    Command cmd;
+    double p0 = cms_now_ms();
+    lex_command(line, &cmd);
+    parse_note(cms_now_ms() - p0);
+    StatKind kind = cmd_stat[cmd.kind];
+    /* EXIT may wait for a background save, which finishes under the exclusive lock */
+    int shared = reads_only(kind) && cmd.kind != CMD_EXIT;
+    if (shared) cms_read_lock(&db_lock); else cms_write_lock(&db_lock);
+    if (shared && ((n_dead && !point_op(kind)) || save_finished())) {   /* purging tombstones and reaping saves need the exclusive lock */
+        cms_read_unlock(&db_lock);
+        cms_write_lock(&db_lock);
+        shared = 0;
+    }
+    double t0 = cms_now_ms();
+    int go = 1;
+    if (!shared) {
+        save_reap();
+        if (!point_op(kind)) store_compact();
+    }
+    if (txn_open && txn_owner != session->client && !outside_txn(cmd.kind)) {   /* no reads of uncommitted changes */
+        out_printf("CMS: Another client has a transaction open. Try again after its COMMIT or ROLLBACK.\n");
+    } else {
+        go = dispatch(&cmd);
+    }
+    double ms = cms_now_ms() - t0;
+    if (shared) cms_read_unlock(&db_lock); else cms_write_unlock(&db_lock);
+    if (!go) return 0;
+    stats_note(kind, ms);
+    if (session->timing_on) out_printf("CMS: Time: %.3f ms\n", ms);
+    return 1;
+}
+
+/* ---- Server mode: cms --serve <socket> [TeamName] ----
+ * Each client connection on the Unix domain socket gets a thread and its own
+ * session; clients speak the same command language as the console. Reads run
+ * concurrently, writes one at a time. A transaction belongs to the client that
+ * began it: other clients' commands (reads too, so nobody sees uncommitted
+ * changes) are refused until it ends, and it is rolled back if that client
+ * disconnects. */
+#ifndef _WIN32
+typedef struct {
+    int fd;
+    int id;
+} ClientConn;
+
+static void* client_main(void* arg) {
+    ClientConn c = *(ClientConn*)arg;
+    free(arg);
+    FILE* in = fdopen(c.fd, "r");
+    int wfd = dup(c.fd);
+    FILE* out = wfd >= 0 ? fdopen(wfd, "w") : NULL;
+    OutBuf* rows = (OutBuf*)malloc(sizeof(OutBuf));
+    if (!in || !out || !rows) {
+        if (in) fclose(in); else close(c.fd);
+        if (out) fclose(out); else if (wfd >= 0) close(wfd);
+        free(rows);
+        return NULL;
+    }
+    rows->fp = out; rows->len = 0;
+    Session s = { in, out, c.id, 0, rows };
+    session = &s;
+
+    out_printf("CMS: Connected as client %d. Type HELP to see available commands.\n", c.id);
+    char line[MAX_LINE];
+    while (1) {
+        save_report();
+        out_printf("You: ");
+        fflush(out);
+        if (!fgets(line,sizeof(line),in)) break;
+        trim(line); if (!line[0]) continue;
+        history_add(line);
+        if (!run_command(line)) break;
+    }
+    fflush(out);
+
+    cms_write_lock(&db_lock);
+    if (txn_open && txn_owner == c.id) {
+        int n = txn_n, ok = txn_rollback();
+        fprintf(console_session.out, "CMS: Client %d left with an open transaction; %d changes rolled back%s.\n",
+                c.id, n, ok ? "" : " (incomplete, out of memory)");
+    }
+    cms_write_unlock(&db_lock);
+    fprintf(console_session.out, "CMS: Client %d disconnected.\n", c.id);
+    fflush(console_session.out);
+    fclose(out);
+    fclose(in);
+    free(rows);
+    return NULL;
+}
+
+static int serve(const char* path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        out_printf("CMS: Socket path \"%s\" is too long.\n", path);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);   /* a client hanging up mid-reply must not kill the server */
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) { out_printf("CMS: Cannot create socket: %s\n", strerror(errno)); return 1; }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);   /* left over from an earlier run */
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+        out_printf("CMS: Cannot listen on \"%s\": %s\n", path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+    out_printf("CMS: Serving on \"%s\" (%d CPUs). Stop with Ctrl+C.\n", path, cms_cpu_count());
+    fflush(session->out);
+
+    int next_id = 1;
+    while (1) {
+        int cfd = accept(fd, NULL, NULL);
+        if (cfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            out_printf("CMS: accept failed: %s\n", strerror(errno));
+            break;
+        }
+        ClientConn* c = (ClientConn*)malloc(sizeof(ClientConn));
+        cms_thread t;
+        if (!c) { close(cfd); continue; }
+        c->fd = cfd; c->id = next_id++;
+        fprintf(console_session.out, "CMS: Client %d connected.\n", c->id);
+        fflush(console_session.out);
+        if (!cms_thread_start(&t, client_main, c)) { free(c); close(cfd); continue; }
+        pthread_detach(t.h);
+    }
+    close(fd);
+    unlink(path);
+    return 1;
 }
+#endif
+
+int main(int argc, char** argv) {
+    console_session.in = stdin;
+    console_session.out = stdout;
+    console_session.rows = &console_rows;
+    session = &console_session;
+
+    if (argc > 1 && strcmp(argv[1],"--serve")==0) {
+        if (argc < 3) { out_printf("Usage: %s --serve <socket-path> [TeamName]\n", argv[0]); return 2; }
+#ifdef _WIN32
+        out_printf("CMS: --serve needs Unix domain sockets and is not supported on this platform.\n");
+        return 1;
+#else
+        if (argc > 3) {
+            char open_cmd[MAX_LINE];
+            snprintf(open_cmd, sizeof(open_cmd), "OPEN %s", argv[3]);
+            run_command(open_cmd);
+        }
+        return serve(argv[2]);
+#endif
+    }
 
-int main(void) {
     print_declaration();
-    printf("Type HELP to see available commands.\n\n");
+    out_printf("Type HELP to see available commands.\n\n");
 
     char line[MAX_LINE];
     while (1) {
-        printf("You: ");
+        save_report();
+        out_printf("You: ");
+        fflush(stdout);   /* reach a pipe (bench driver) before blocking on input */
         if (!fgets(line,sizeof(line),stdin)) break;
         trim(line); if (!line[0]) continue;
         history_add(line);
-        char cmd[MAX_LINE]; strncpy(cmd,line,sizeof(cmd)-1); cmd[sizeof(cmd)-1]=0;
-        char up[MAX_LINE]; strncpy(up,line,sizeof(up)-1); up[sizeof(up)-1]=0; strtoupper_inplace(up);
-
-        if (strncmp(up,"EXIT",4)==0 || strncmp(up,"QUIT",4)==0) {
-            printf("CMS: Bye!\n"); break;
-        } else if (strncmp(up,"HELP",4)==0) {
-            cmd_help();
-        } else if (strncmp(up,"OPEN",4)==0) {
-            char* p = cmd+4; while (*p && isspace((unsigned char)*p)) p++;
-            if (!*p) { printf("CMS: Please provide a team name. e.g., OPEN P10-09\n"); continue; }
-            strncpy(team_name,p,sizeof(team_name)-1); team_name[sizeof(team_name)-1]=0; trim(team_name);
-            ensure_filename_from_team();
-            if (load_db(db_filename)) {
-                printf("CMS: Opened \"%s\" (%d records).\n", db_filename, n_records);
-            } else {
-                n_records=0;
-                printf("CMS: New database will be created on SAVE → \"%s\" (0 records currently).\n", db_filename);
-            }
-        } else if (strncmp(up,"SHOW ALL",8)==0) {
-            char* args = cmd+8; cmd_show_all(args);
-        } else if (strncmp(up,"SHOW PROGRAMME SUMMARY",22)==0) {
-            cmd_show_programme_summary();
-        } else if (strncmp(up,"SHOW PROGRAMME",14)==0) {
-            cmd_show_programme_exact(cmd);
-        } else if (strncmp(up,"SHOW SUMMARY",12)==0) {
-            cmd_show_summary();
-        } else if (strncmp(up,"INSERT",6)==0) {
-            cmd_insert(cmd);
-        } else if (strncmp(up,"QUERY",5)==0) {
-            cmd_query(cmd);
-        } else if (strncmp(up,"UPDATE",6)==0) {
-            cmd_update(cmd);
-        } else if (strncmp(up,"DELETE",6)==0) {
-            cmd_delete(cmd);
-        } else if (strncmp(up,"FIND",4)==0) {
-            cmd_find_name(cmd);
-        } else if (strncmp(up,"SET AUTOSAVE",12)==0) {
-            if (strstr(up,"ON")) { autosave_on=1; printf("CMS: AUTOSAVE is ON.\n"); }
-            else if (strstr(up,"OFF")) { autosave_on=0; printf("CMS: AUTOSAVE is OFF.\n"); }
-            else { printf("CMS: Usage → SET AUTOSAVE ON|OFF\n"); }
-        } else if (strncmp(up,"EXPORT",6)==0) {
-            cmd_export_csv(cmd);
-        } else if (strncmp(up,"SAVE",4)==0) {
-            if (!db_filename[0]) { printf("CMS: Please OPEN <TeamName> first.\n"); }
-            else {
-                if (save_db(db_filename)) printf("CMS: The database file \"%s\" is successfully saved.\n", db_filename);
-                else printf("CMS: Failed to save database file. Check permissions.\n");
-            }
-        } else if (strncmp(up,"UNDO",4)==0) {
-            cmd_undo();
-        } else if (strncmp(up,"HISTORY",7)==0) {
-            cmd_history();
-        } else {
-            printf("CMS: Unknown command. Type HELP.\n");
-        }
+        if (!run_command(line)) break;
     }
+    cms_write_lock(&db_lock);   /* end of input: let a running save finish */
+    save_drain();
+    cms_write_unlock(&db_lock);
+    save_report();
     return 0;
 }
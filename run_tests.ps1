@@ -15,6 +15,16 @@ function Run-Case {
     "delete_undo" { if ($out -match "(?i)successfully deleted" -and $out -match "(?i)UNDO successful" -and $out -match "(?i)record with ID=999001 is found") {$ok=$true} }
     "sort" { if ($out -match "(?i)Here are all the records") {$ok=$true} }
     "find" { if ($out -match "(?i)Search results") {$ok=$true} }
+    "txn" { if ($out -match "(?i)rolled back" -and $out -match "(?i)ID=2999999 does not exist") {$ok=$true} }
+    "import" { if ($out -match "(?i)Imported 2 records" -and $out -match "(?i)1 rejected" -and $out -match "(?i)reverted last IMPORT") {$ok=$true} }
+    "stats" { if ($out -match "(?i)Time: .* ms" -and $out -match "(?i)Statistics since start") {$ok=$true} }
+    "confirm" { if ($out -match "(?i)deletion is cancelled" -and $out -match "(?i)ID=2999998 does not exist") {$ok=$true} }
+    "redo" { if ($out -match "(?i)REDO successful \(reapplied UPDATE of ID=2999997\)" -and $out -match "75\.00" -and $out -match "(?i)REDO successful \(reapplied IMPORT of 2 records\)" -and $out -match "(?i)REDO successful \(reapplied UPDATE of ID=2999992\)" -and $out -match "88\.00") {$ok=$true} }
+    "where" { if ($out -match "(?i)1 of \d+ records .* match" -and $out -match "(?i)2 of \d+ records .* match" -and $out -match '(?i)Cannot read the WHERE clause at "OR Mark<10"') {$ok=$true} }
+    "threads" { if ($out -match "(?i)uses 3 thread" -and $out -match "(?i)1 of \d+ records .* match" -and $out -match "(?i)Usage .* SET THREADS" -and $out -match "(?i)one thread per CPU") {$ok=$true} }
+    "export" { if ($out -match "(?i)Exported 2 records" -and $out -match "(?i)Exported 1 records" -and (Get-Content "tests\export.jsonl" -Raw) -match '^\{"id":2304567,' -and (Get-Content "tests\export.tsv" -Raw) -match "Joshua Chen") {$ok=$true} }
+    "wide" { if ($out -match "Average mark : 25000000376" -and $out -match "Std deviation: 43301270840" -and $out -match "Computer Science +2 +500000007" -and $out -match "Average mark : 73\.27" -and $out -match "Std deviation: 9\.39") {$ok=$true} }
+    "paging" { if ($out -match "(?i)Showing records 1-2" -and $out -match "(?i)Showing records 2-2" -and $out -match '(?i)Cannot read the options at "FOO"' -and $out -match '(?i)Cannot read the options at "DESCX"') {$ok=$true} }
   }
   if ($ok) { Write-Host "[PASS] $Name"; $global:pass++ } else { Write-Host "[FAIL] $Name"; $global:fail++ }
 }
@@ -22,5 +32,15 @@ Run-Case -Name "basic" -InFile "tests\basic.in"
 Run-Case -Name "delete_undo" -InFile "tests\delete_undo.in"
 Run-Case -Name "sort" -InFile "tests\sort.in"
 Run-Case -Name "find" -InFile "tests\find.in"
+Run-Case -Name "paging" -InFile "tests\paging.in"
+Run-Case -Name "txn" -InFile "tests\txn.in"
+Run-Case -Name "import" -InFile "tests\import.in"
+Run-Case -Name "stats" -InFile "tests\stats.in"
+Run-Case -Name "confirm" -InFile "tests\confirm.in"
+Run-Case -Name "redo" -InFile "tests\redo.in"
+Run-Case -Name "where" -InFile "tests\where.in"
+Run-Case -Name "threads" -InFile "tests\threads.in"
+Run-Case -Name "export" -InFile "tests\export.in"
+Run-Case -Name "wide" -InFile "tests\wide.in"
 Write-Host ""; Write-Host "Passed: $pass  Failed: $fail"
 if ($fail -eq 0) { exit 0 } else { exit 1 }
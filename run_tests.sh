@@ -1,7 +1,7 @@
 #!/usr/bin/env bash
 set -e
 echo "Compiling cms.c ..."
-gcc -std=c99 -O2 cms.c -o cms
+gcc -std=c99 -O2 -pthread cms.c -o cms
 
 pass=0; fail=0
 run_case () {
@@ -29,6 +29,54 @@ run_case () {
     find)
       grep -qi "Search results" "$out" && ok=1
       ;;
+    txn)
+      grep -qi "rolled back" "$out" && \
+      grep -qi "ID=2999999 does not exist" "$out" && ok=1
+      ;;
+    import)
+      grep -qi "Imported 2 records" "$out" && \
+      grep -qi "1 rejected" "$out" && \
+      grep -qi "reverted last IMPORT" "$out" && ok=1
+      ;;
+    confirm)
+      grep -qi "deletion is cancelled" "$out" && \
+      grep -qi "ID=2999998 does not exist" "$out" && ok=1
+      ;;
+    redo)
+      grep -qi "REDO successful (reapplied UPDATE of ID=2999997)" "$out" && \
+      grep -qi "75.00" "$out" && \
+      grep -qi "REDO successful (reapplied IMPORT of 2 records)" "$out" && \
+      grep -qi "REDO successful (reapplied UPDATE of ID=2999992)" "$out" && \
+      grep -qi "88.00" "$out" && ok=1
+      ;;
+    stats)
+      grep -qi "Time: .* ms" "$out" && \
+      grep -qi "Statistics since start" "$out" && ok=1
+      ;;
+    where)
+      grep -qi "1 of [0-9]* records .* match" "$out" && \
+      grep -qi "2 of [0-9]* records .* match" "$out" && \
+      grep -qi 'Cannot read the WHERE clause at "OR Mark<10"' "$out" && ok=1
+      ;;
+    threads)
+      grep -qi "uses 3 thread" "$out" && grep -qi "1 of [0-9]* records .* match" "$out" && \
+      grep -qi "Usage .* SET THREADS" "$out" && grep -qi "one thread per CPU" "$out" && ok=1
+      ;;
+    export)
+      grep -qi "Exported 2 records" "$out" && grep -qi "Exported 1 records" "$out" && \
+      grep -q '^{"id":2304567,' tests/export.jsonl && grep -q "Joshua Chen" tests/export.tsv && ok=1
+      ;;
+    paging)
+      grep -qi "Showing records 1-2" "$out" && \
+      grep -qi "Showing records 2-2" "$out" && \
+      grep -qi 'Cannot read the options at "FOO"' "$out" && \
+      grep -qi 'Cannot read the options at "DESCX"' "$out" && ok=1
+      ;;
+    wide)
+      grep -q "Average mark : 25000000376" "$out" && grep -q "Std deviation: 43301270840" "$out" && \
+      grep -q "Computer Science  *2  *500000007" "$out" && \
+      grep -q "Average mark : 73.27" "$out" && grep -q "Std deviation: 9.39" "$out" && ok=1
+      ;;
   esac
   if [ $ok -eq 1 ]; then echo "[PASS] $name"; pass=$((pass+1)); else echo "[FAIL] $name"; fail=$((fail+1)); fi
 }
@@ -36,5 +84,15 @@ run_case basic tests/basic.in
 run_case delete_undo tests/delete_undo.in
 run_case sort tests/sort.in
 run_case find tests/find.in
+run_case paging tests/paging.in
+run_case txn tests/txn.in
+run_case import tests/import.in
+run_case stats tests/stats.in
+run_case confirm tests/confirm.in
+run_case redo tests/redo.in
+run_case where tests/where.in
+run_case threads tests/threads.in
+run_case export tests/export.in
+run_case wide tests/wide.in
 echo ""; echo "Passed: $pass  Failed: $fail"
 test $fail -eq 0